@@ -5,3 +5,35 @@ typedef struct {
 	uint8_t *buf;
 	uint32_t off, len, cap, sav;
 } LeveeBuffer;
+
+typedef struct {
+	uint8_t *buf;
+	uint32_t off, len, cap, sav, mark;
+} LeveeMirror;
+
+typedef struct {
+	uint64_t hits;   /* blocks served from the pool */
+	uint64_t misses; /* blocks that fell through to malloc */
+	uint64_t puts;   /* blocks returned to the pool */
+	uint64_t drops;  /* blocks freed as their class was full */
+	uint64_t cached; /* blocks currently idle in the pool */
+	uint64_t bytes;  /* bytes currently idle in the pool */
+} LeveeBufferPoolStats;
+
+uint8_t *
+levee_buffer_pool_get (uint32_t cap);
+
+void
+levee_buffer_pool_put (uint8_t *block, uint32_t cap);
+
+void
+levee_buffer_pool_stats (LeveeBufferPoolStats *stats);
+
+void
+levee_buffer_pool_clear (void);
+
+uint8_t *
+levee_buffer_mirror_map (uint32_t cap);
+
+void
+levee_buffer_mirror_unmap (uint8_t *block, uint32_t cap);
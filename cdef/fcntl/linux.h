@@ -10,6 +10,10 @@ static const int F_GETFD = 1; /* Get file descriptor flags.  */
 static const int F_SETFD = 2; /* Set file descriptor flags.  */
 static const int F_GETFL = 3; /* Get file status flags.  */
 static const int F_SETFL = 4; /* Set file status flags.  */
+static const int F_SETPIPE_SZ = 1031; /* Set pipe capacity.  */
+static const int F_GETPIPE_SZ = 1032; /* Get pipe capacity.  */
+
+static const int FD_CLOEXEC = 1;
 
 static const int O_ACCMODE =      0003;
 static const int O_RDONLY =         00;
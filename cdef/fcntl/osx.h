@@ -6,6 +6,8 @@ static const int F_SETFD = 2; /* Set file descriptor flags.  */
 static const int F_GETFL = 3; /* Get file status flags.  */
 static const int F_SETFL = 4; /* Set file status flags.  */
 
+static const int FD_CLOEXEC = 1;
+
 static const int O_ACCMODE =      0003;
 static const int O_RDONLY =         00;
 static const int O_WRONLY =         01;
@@ -42,20 +42,54 @@ levee_get_error (Levee *self);
 extern size_t
 levee_getcurrentrss ();
 
+static const unsigned LEVEE_DIALER_TTL = 30000;
+static const unsigned LEVEE_DIALER_NEGATIVE_TTL = 5000;
+
+typedef struct LeveeDialerEntry LeveeDialerEntry;
+
 struct LeveeDialerState {
 	int rc;
-	int io[2];
 };
 
-struct LeveeDialerRequest {
-	uint16_t node_len;
-	uint16_t service_len;
-	uint16_t family;
-	uint16_t socktype;
-	uint8_t is_listening;
-	int no;
+struct LeveeDialerResponse {
+	int err;
+	uint32_t id;
+	struct addrinfo *info;
+	LeveeDialerEntry *entry;
 };
 
+typedef struct {
+	uint64_t hits;        /* lookups answered from the cache */
+	uint64_t negative;    /* of those, cached failures */
+	uint64_t misses;      /* lookups handed to the resolver threads */
+	uint64_t resolved;    /* getaddrinfo calls completed */
+	uint64_t failed;      /* of those, calls that returned an error */
+	uint64_t latency;     /* total time spent in getaddrinfo, in microseconds */
+	uint64_t latency_max; /* slowest getaddrinfo call, in microseconds */
+	uint32_t pending;     /* requests waiting for a resolver thread */
+	uint32_t threads;     /* resolver threads running */
+	uint32_t cached;      /* entries in the cache */
+} LeveeDialerStats;
 
 extern const struct LeveeDialerState
-levee_dialer_init ();
+levee_dialer_init (void);
+
+extern int
+levee_dialer_configure (uint32_t threads, uint32_t ttl, uint32_t negative_ttl);
+
+extern int
+levee_dialer_lookup (const char *node, const char *service,
+		uint16_t family, uint16_t socktype, struct LeveeDialerResponse *res);
+
+extern int
+levee_dialer_submit (const char *node, const char *service,
+		uint16_t family, uint16_t socktype, int no, uint32_t id);
+
+extern void
+levee_dialer_release (LeveeDialerEntry *entry);
+
+extern void
+levee_dialer_flush (void);
+
+extern void
+levee_dialer_stats (LeveeDialerStats *stats);
@@ -9,6 +9,15 @@ struct LeveeNode {
 	LeveeNode *next;
 };
 
+typedef struct LeveeQueue LeveeQueue;
+
+struct LeveeQueue {
+	LeveeNode *head;  /* swapped by producers */
+	char pad[56];     /* keeps head and tail on separate cache lines */
+	LeveeNode *tail;  /* only touched by the consumer */
+	LeveeNode stub;
+};
+
 extern void
 levee_list_init (LeveeList *self);
 
@@ -21,3 +30,11 @@ levee_list_pop (LeveeList *self);
 extern LeveeNode *
 levee_list_drain (LeveeList *self, bool reverse);
 
+extern void
+levee_queue_init (LeveeQueue *self);
+
+extern void
+levee_queue_push (LeveeQueue *self, LeveeNode *node);
+
+extern LeveeNode *
+levee_queue_pop (LeveeQueue *self);
@@ -52,8 +52,11 @@ local headers = {
 	include("ioctl", "ioctl"),
 	include("ioctl", os),
 	include("poller", os),
+	include("uring", os),
 	include("buffer", "buffer"),
 	include("heap", "heap"),
+	include("pool", "pool"),
+	include("wheel", "wheel"),
 	include("list", "list"),
 	include("channel", "channel"),
 	include("dns", "dns"),
@@ -0,0 +1,10 @@
+typedef struct {
+	uint64_t hits;   /* allocations served from a free list */
+	uint64_t misses; /* allocations that fell through to malloc */
+	uint64_t frees;  /* blocks freed back on to the allocating thread */
+	uint64_t remote; /* blocks reclaimed after being freed by other threads */
+	uint64_t cached; /* blocks currently held on this thread's free lists */
+} LeveePoolStats;
+
+void
+levee_pool_stats (LeveePoolStats *stats);
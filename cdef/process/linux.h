@@ -2,3 +2,11 @@ static const int PR_SET_PDEATHSIG = 1;
 
 int prctl(int option, unsigned long arg2, unsigned long arg3,
           unsigned long arg4, unsigned long arg5);
+
+static const int _SC_NPROCESSORS_ONLN = 84;
+
+typedef struct {
+	unsigned long __bits[1024 / (8 * sizeof (unsigned long))];
+} cpu_set_t;
+
+int sched_setaffinity(int pid, size_t cpusetsize, const cpu_set_t *mask);
@@ -1,3 +1,5 @@
+static const int _SC_NPROCESSORS_ONLN = 58;
+
 struct proc_fdinfo {
 	int32_t  proc_fd;
 	uint32_t proc_fdtype;
@@ -3,6 +3,8 @@ int getppid(void);
 int kill(int pid, int sig);
 int fork(void);
 
+long sysconf(int name);
+
 static const int WNOHANG = 1;
 static const int WUNTRACED = 2;
 static const int WCONTINUED = 8;
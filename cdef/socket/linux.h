@@ -3,9 +3,15 @@ static const int AF_INET6 = PF_INET6;
 
 static const int SOL_SOCKET    = 1;
 static const int SO_REUSEADDR  = 2;
+static const int SO_REUSEPORT  = 15;
 static const int SO_ACCEPTCONN = 30;
 static const int SO_DOMAIN     = 39;
 
+static const int SOCK_NONBLOCK = 04000;
+static const int SOCK_CLOEXEC  = 02000000;
+
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+
 static const int NI_NUMERICHOST = 1;
 static const int NI_NUMERICSERV = 2;
 static const int NI_NOFQDN      = 4;
@@ -58,3 +64,40 @@ struct addrinfo {
 	char *ai_canonname;         /* canonical name for service location */
 	struct addrinfo *ai_next;   /* pointer to next in list */
 };
+
+static const int IPPROTO_TCP = 6;
+static const int TCP_CORK    = 3;
+
+static const int SOL_UDP     = 17;
+static const int UDP_SEGMENT = 103;
+static const int UDP_GRO     = 104;
+
+static const int MSG_PEEK = 0x02;
+static const int MSG_TRUNC = 0x20;
+
+struct msghdr {
+	void *msg_name;
+	socklen_t msg_namelen;
+	struct iovec *msg_iov;
+	size_t msg_iovlen;
+	void *msg_control;
+	size_t msg_controllen;
+	int msg_flags;
+};
+
+struct mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+};
+
+struct cmsghdr {
+	size_t cmsg_len;
+	int cmsg_level;
+	int cmsg_type;
+};
+
+int recvmmsg(
+	int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+	struct timespec *timeout);
+int sendmmsg(
+	int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags);
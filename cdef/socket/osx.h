@@ -3,8 +3,11 @@ static const int AF_INET6 = PF_INET6;
 
 static const int SOL_SOCKET    = 0xffff;
 static const int SO_REUSEADDR  = 0x0004;
+static const int SO_REUSEPORT  = 0x0200;
 static const int SO_ACCEPTCONN = 0x0002;
 
+static const int MSG_PEEK = 0x02;
+
 static const int NI_NOFQDN      = 0x00000001;
 static const int NI_NUMERICHOST = 0x00000002;
 static const int NI_NAMEREQD    = 0x00000004;
@@ -5,6 +5,7 @@ void free(void *);
 void memcpy(void *restrict, const void *restrict, size_t);
 void memmove(void *restrict, const void *restrict, size_t);
 void *memset(void *b, int c, size_t len);
+int strncasecmp(const char *s1, const char *s2, size_t n);
 int getpagesize(void);
 
 
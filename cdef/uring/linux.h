@@ -0,0 +1,27 @@
+typedef struct LeveeUring LeveeUring;
+
+typedef struct {
+	uint64_t enters;  /* io_uring_enter calls */
+	uint64_t sqes;    /* requests submitted */
+	uint64_t cqes;    /* completions reaped */
+	uint64_t polls;   /* multishot polls armed, including re-arms */
+	uint64_t stale;   /* completions for fds since unregistered */
+} LeveeUringStats;
+
+LeveeUring *
+levee_uring_create (uint32_t entries, int epfd);
+
+void
+levee_uring_destroy (LeveeUring *self);
+
+int
+levee_uring_register (LeveeUring *self, int fd, uint32_t events);
+
+int
+levee_uring_unregister (LeveeUring *self, int fd);
+
+int
+levee_uring_wait (LeveeUring *self, int64_t ms, struct epoll_event *ev, int max);
+
+void
+levee_uring_stats (const LeveeUring *self, LeveeUringStats *stats);
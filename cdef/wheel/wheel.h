@@ -0,0 +1,37 @@
+typedef struct LeveeWheel LeveeWheel;
+typedef struct LeveeWheelLink LeveeWheelLink;
+typedef struct LeveeWheelItem LeveeWheelItem;
+
+struct LeveeWheelLink {
+	LeveeWheelLink *next, *prev;
+};
+
+struct LeveeWheelItem {
+	LeveeWheelLink link;
+	LeveeWheel *wheel;
+	int64_t expires;
+};
+
+LeveeWheel *
+levee_wheel_create (int64_t now);
+
+void
+levee_wheel_destroy (LeveeWheel *self);
+
+uint32_t
+levee_wheel_count (const LeveeWheel *self);
+
+LeveeWheelItem *
+levee_wheel_add (LeveeWheel *self, int64_t expires);
+
+void
+levee_wheel_remove (LeveeWheel *self, LeveeWheelItem *item);
+
+int64_t
+levee_wheel_next (const LeveeWheel *self);
+
+LeveeWheelItem *
+levee_wheel_expire (LeveeWheel *self, int64_t now);
+
+void
+levee_wheel_clear (LeveeWheel *self);
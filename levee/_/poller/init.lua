@@ -1,2 +1,13 @@
 local ffi = require("ffi")
-return require("levee._.poller." .. ffi.os:lower())
+
+local Poller = require("levee._.poller." .. ffi.os:lower())
+
+-- backend may be "uring" to ask for the io_uring poller on Linux. it falls back
+-- to the platform's poller where io_uring isn't available
+return function(backend)
+	if backend == "uring" and ffi.os == "Linux" then
+		local poller = require("levee._.poller.uring")()
+		if poller then return poller end
+	end
+	return Poller()
+end
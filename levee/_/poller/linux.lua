@@ -14,10 +14,15 @@ typedef struct epoll_event LeveePollerEvent;
 struct LeveePoller {
 	int fd;
 	int tmp[1];
-	struct timeval tv;
+	struct timespec ts;
+	int64_t now;  /* CLOCK_MONOTONIC in ms, read once per poll */
+	int64_t wall; /* CLOCK_REALTIME_COARSE in seconds, read on demand */
 	struct epoll_event ev[EV_POLL_OUT_MAX];
 	int sigs[SIGNAL_MAX];
 	char buf[SIZEOF_SIGNALFD_SIGINFO];
+	struct epoll_event *events; /* ev, or an allocation for larger batches */
+	int size, min_size, max_size, want, idle;
+	uint64_t polls, wakeups, returned, full;
 };
 ]]
 
@@ -57,21 +62,107 @@ local Poller = {}
 Poller.__index = Poller
 
 
+Poller.backend = "epoll"
+
+
+-- a batch shrinks after this many polls in a row at most a quarter full
+local SHRINK_AFTER = 16
+
+
 function Poller:__new()
 	local self = ffi.new(self, C.epoll_create1(0))
 	if self.fd < 0 then errors.get(ffi.errno()):abort() end
-	C.gettimeofday(self.tv, nil)
+	self:_clock()
+	self:batch(C.EV_POLL_OUT_MAX)
 	return self
 end
 
 
-function Poller:__tostring()
-	return string.format("levee.Poller(epoll): %d", self.fd)
+function Poller:__gc()
+	self:_resize(0)
+	C.close(self.fd)
 end
 
 
-function Poller:__gc()
-	C.close(self.fd)
+-- sets the number of events returned per poll to `size`. with `max` the
+-- batch adapts: it doubles, up to `max`, after a poll fills it and halves,
+-- down to `size`, once polls have stayed mostly empty for a while
+function Poller:batch(size, max)
+	assert(size > 0 and (not max or max >= size))
+	self.min_size = size
+	self.max_size = max or size
+	self.want = size
+	self:_resize(size)
+end
+
+
+function Poller:_resize(size)
+	if self.events ~= nil and self.events ~= self.ev then
+		C.free(self.events)
+	end
+	self.events = nil
+	self.size = 0
+	if size == 0 then return end
+
+	if size <= C.EV_POLL_OUT_MAX then
+		self.events = self.ev
+	else
+		self.events = C.malloc(size * ffi.sizeof("struct epoll_event"))
+		if self.events == nil then
+			-- keep polling with the inline batch if the allocation fails
+			self.events = self.ev
+			size = C.EV_POLL_OUT_MAX
+		end
+	end
+	self.size = size
+	self.want = size
+end
+
+
+-- counts a poll's events and picks the batch size for the next poll. the
+-- events are still in use by the caller, so the resize waits until then
+function Poller:_account(n)
+	self.polls = self.polls + 1
+	if n > 0 then
+		self.wakeups = self.wakeups + 1
+		self.returned = self.returned + n
+	end
+
+	if n == self.size then
+		self.full = self.full + 1
+		self.idle = 0
+		if self.size < self.max_size then
+			self.want = math.min(self.size * 2, self.max_size)
+		end
+	elseif n * 4 <= self.size then
+		self.idle = self.idle + 1
+		if self.idle >= SHRINK_AFTER and self.size > self.min_size then
+			self.want = math.max(math.floor(self.size / 2), self.min_size)
+			self.idle = 0
+		end
+	else
+		self.idle = 0
+	end
+end
+
+
+function Poller:stats()
+	local wakeups = tonumber(self.wakeups)
+	local returned = tonumber(self.returned)
+	local full = tonumber(self.full)
+	return {
+		size = self.size,
+		polls = tonumber(self.polls),
+		wakeups = wakeups,
+		events = returned,
+		mean = wakeups > 0 and returned / wakeups or 0,
+		full = full,
+		full_rate = wakeups > 0 and full / wakeups or 0, }
+end
+
+
+function Poller:__tostring()
+	return string.format("levee.Poller(epoll): %d", self.fd)
 end
 
 
@@ -151,13 +242,16 @@ function Poller:poll(timeout)
 		end
 	end
 
-	local n = C.epoll_wait(self.fd, self.ev, C.EV_POLL_OUT_MAX, ms)
+	if self.want ~= self.size then self:_resize(self.want) end
+
+	local n = C.epoll_wait(self.fd, self.events, self.size, ms)
 	local err = ffi.errno()
 
-	C.gettimeofday(self.tv, nil)
+	self:_clock()
 
 	if n >= 0 then
-		return nil, self.ev, n
+		self:_account(n)
+		return nil, self.events, n
 	end
 
 	local err = errors.get(err)
@@ -167,13 +261,32 @@ function Poller:poll(timeout)
 end
 
 
+-- timers run off the monotonic clock so they aren't thrown by the wall clock
+-- being stepped. it's read once per poll through the vDSO, and the coarse
+-- wall clock is only read if something asks for it before the next poll
+function Poller:_clock()
+	C.clock_gettime(C.CLOCK_MONOTONIC, self.ts)
+	self.now = self.ts.tv_sec * 1000LL + self.ts.tv_nsec / 1000000LL
+	self.wall = -1
+end
+
+
+function Poller:time()
+	if self.wall < 0 then
+		C.clock_gettime(C.CLOCK_REALTIME_COARSE, self.ts)
+		self.wall = self.ts.tv_sec
+	end
+	return tonumber(self.wall)
+end
+
+
 function Poller:abstime(rel)
-	return rel + ((self.tv.tv_sec * 1000LL) + (self.tv.tv_usec / 1000LL))
+	return rel + self.now
 end
 
 
 function Poller:reltime(abs)
-	return abs - ((self.tv.tv_sec * 1000LL) + (self.tv.tv_usec / 1000LL))
+	return abs - self.now
 end
 
 
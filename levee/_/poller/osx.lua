@@ -14,7 +14,8 @@ struct LeveePoller {
 	int fd;
 	int ev_in_pos;
 	uintptr_t id;
-	struct timeval tv;
+	int64_t now;  /* mach_absolute_time in ms, read once per poll */
+	int64_t wall; /* time(), read on demand */
 	struct timespec ts;
 	struct kevent ev_in[EV_POLL_IN_MAX];
 	LeveePollerEvent ev_out[EV_POLL_OUT_MAX];
@@ -22,6 +23,13 @@ struct LeveePoller {
 ]]
 
 
+local timebase = ffi.new("struct mach_timebase_info")
+assert(C.mach_timebase_info(timebase) == 0)
+-- ticks per ms, as a fraction
+local TICKS_NUMER = ffi.cast("uint64_t", timebase.numer)
+local TICKS_DENOM = ffi.cast("uint64_t", timebase.denom) * 1000000ULL
+
+
 local SIG_DFL = ffi.cast("sighandler_t", 0)
 local SIG_IGN = ffi.cast("sighandler_t", 1)
 
@@ -56,10 +64,13 @@ local Poller = {}
 Poller.__index = Poller
 
 
+Poller.backend = "kqueue"
+
+
 function Poller:__new()
 	local self = ffi.new(self, C.kqueue(), 0, 0)
 	if self.fd < 0 then error("kqueue") end
-	C.gettimeofday(self.tv, nil)
+	self:_clock()
 	return self
 end
 
@@ -179,7 +190,7 @@ function Poller:poll(timeout)
 		self.fd, self.ev_in, self.ev_in_pos, self.ev_out, C.EV_POLL_OUT_MAX, ts)
 	local err = ffi.errno()
 
-	C.gettimeofday(self.tv, nil)
+	self:_clock()
 
 	if n >= 0 then
 		self.ev_in_pos = 0
@@ -193,13 +204,26 @@ function Poller:poll(timeout)
 end
 
 
+-- timers run off the monotonic clock, read once per poll
+function Poller:_clock()
+	self.now = C.mach_absolute_time() * TICKS_NUMER / TICKS_DENOM
+	self.wall = -1
+end
+
+
+function Poller:time()
+	if self.wall < 0 then self.wall = C.time(nil) end
+	return tonumber(self.wall)
+end
+
+
 function Poller:abstime(rel)
-	return rel + ((self.tv.tv_sec * 1000LL) + (self.tv.tv_usec / 1000LL))
+	return rel + self.now
 end
 
 
 function Poller:reltime(abs)
-	return abs - ((self.tv.tv_sec * 1000LL) + (self.tv.tv_usec / 1000LL))
+	return abs - self.now
 end
 
 
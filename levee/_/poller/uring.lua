@@ -0,0 +1,138 @@
+local ffi = require('ffi')
+local C = ffi.C
+
+local errors = require("levee.errors")
+
+local Epoll = require("levee._.poller.linux")
+
+
+--
+-- Poller
+
+-- An io_uring backed poller. fds are armed with multishot polls, so each
+-- register and unregister is queued on the ring and submitted along with the
+-- next wait, making a pump a single io_uring_enter. Channels and signals
+-- still register with epoll_ctl on `fd`, an epoll instance the ring watches,
+-- and events from both are returned as epoll_events.
+--
+-- Unlike epoll, a poll on the ring holds a reference to the fd's file, so an
+-- fd must be unregistered before it's closed for the close to take effect.
+-- The hub's unregister takes care of this.
+
+local Poller_mt = {}
+Poller_mt.__index = Poller_mt
+
+
+Poller_mt.backend = "uring"
+
+
+function Poller_mt:__tostring()
+	return string.format("levee.Poller(uring): %d", self.fd)
+end
+
+
+function Poller_mt:signal_register(no)
+	return self.epoll:signal_register(no)
+end
+
+
+function Poller_mt:signal_unregister(no)
+	return self.epoll:signal_unregister(no)
+end
+
+
+function Poller_mt:signal_clear(no)
+	return self.epoll:signal_clear(no)
+end
+
+
+function Poller_mt:register(fd, r, w)
+	local events = bit.bor(C.EPOLLERR, C.EPOLLHUP)
+	if r then
+		events = bit.bor(events, C.EPOLLIN)
+	end
+	if w then
+		events = bit.bor(events, C.EPOLLOUT)
+	end
+	local rc = C.levee_uring_register(self.ring, fd, events)
+	if rc < 0 then errors.get(rc):abort() end
+end
+
+
+function Poller_mt:unregister(fd)
+	local rc = C.levee_uring_unregister(self.ring, fd)
+	if rc < 0 then errors.get(rc):abort() end
+end
+
+
+function Poller_mt:poll(timeout)
+	local ms = -1
+	if timeout then
+		if timeout > 0 then
+			ms = self:reltime(timeout)
+			if ms < 0 then
+				ms = 0
+			end
+		else
+			ms = 0
+		end
+	end
+
+	-- events are batched in the epoll poller's array, so it sizes the batch
+	local epoll = self.epoll
+	if epoll.want ~= epoll.size then epoll:_resize(epoll.want) end
+
+	local n = C.levee_uring_wait(self.ring, ms, epoll.events, epoll.size)
+
+	epoll:_clock()
+
+	if n < 0 then errors.get(n):abort() end
+	epoll:_account(n)
+	return nil, epoll.events, n
+end
+
+
+function Poller_mt:batch(size, max)
+	return self.epoll:batch(size, max)
+end
+
+
+function Poller_mt:time()
+	return self.epoll:time()
+end
+
+
+function Poller_mt:abstime(rel)
+	return self.epoll:abstime(rel)
+end
+
+
+function Poller_mt:reltime(abs)
+	return self.epoll:reltime(abs)
+end
+
+
+function Poller_mt:stats()
+	local stats = ffi.new("LeveeUringStats")
+	C.levee_uring_stats(self.ring, stats)
+	local ret = self.epoll:stats()
+	ret.enters = tonumber(stats.enters)
+	ret.sqes = tonumber(stats.sqes)
+	ret.cqes = tonumber(stats.cqes)
+	ret.armed = tonumber(stats.polls)
+	ret.stale = tonumber(stats.stale)
+	return ret
+end
+
+
+-- returns nil if the kernel doesn't support the io_uring features needed
+return function(entries)
+	local epoll = Epoll()
+	local ring = C.levee_uring_create(entries or 256, epoll.fd)
+	if ring == nil then return end
+	ring = ffi.gc(ring, C.levee_uring_destroy)
+	return setmetatable({
+		epoll = epoll,
+		ring = ring,
+		fd = epoll.fd, }, Poller_mt)
+end
@@ -65,4 +65,50 @@ else
 end
 
 
+_.cpu_count = function()
+	local n = C.sysconf(C._SC_NPROCESSORS_ONLN)
+	if n < 1 then return 1 end
+	return tonumber(n)
+end
+
+
+if ffi.os:lower() == "linux" then
+	-- pins the calling OS thread to `cpu`
+	_.set_affinity = function(cpu)
+		local set = ffi.new("cpu_set_t")
+		-- the set's bits aren't bounds checked
+		if cpu < 0 or cpu >= 8 * ffi.sizeof(set) then
+			return errors.system.EINVAL
+		end
+		local bits = 8 * ffi.sizeof(set.__bits[0])
+		local i = math.floor(cpu / bits)
+		set.__bits[i] = bit.lshift(1ULL, cpu % bits)
+		local rc = C.sched_setaffinity(0, ffi.sizeof(set), set)
+		if rc < 0 then return errors.get(ffi.errno()) end
+	end
+else
+	-- OSX only offers affinity hints via thread_policy_set, which aren't
+	-- binding, so pinning is unsupported
+	_.set_affinity = function(cpu)
+		return errors.system.ENOTSUP
+	end
+end
+
+
+-- returns the calling OS thread's counters for the free lists that back heap
+-- and wheel items and channel nodes
+_.pool_stats = function()
+	local stats = ffi.new("LeveePoolStats")
+	C.levee_pool_stats(stats)
+	local hits, misses = tonumber(stats.hits), tonumber(stats.misses)
+	return {
+		hits = hits,
+		misses = misses,
+		hit_rate = hits + misses > 0 and hits / (hits + misses) or 0,
+		frees = tonumber(stats.frees),
+		remote = tonumber(stats.remote),
+		cached = tonumber(stats.cached), }
+end
+
+
 return _
@@ -241,6 +241,17 @@ _.sendto = function(no, ep, buf, len)
 end
 
 
+-- returns true if the peer of a connected socket that's meant to be idle has
+-- hung up or sent something unasked for, or the socket has an error
+local peek = ffi.new("char[1]")
+_.hungup = function(no)
+	local n = C.recvfrom(no, peek, 1, C.MSG_PEEK, nil, nil)
+	if n >= 0 then return true end
+	local err = errors.get(ffi.errno())
+	return not err.is_system_EAGAIN
+end
+
+
 _.recvfrom = function(no, buf, len)
 	local ep = _.endpoint()
 	local n = C.recvfrom(no, buf, len, 0, ep.addr.sa, ep.len)
@@ -278,6 +289,19 @@ if ffi.os:lower() == "linux" then
 		if n >= 0 then return nil, tonumber(n) end
 		return errors.get(ffi.errno())
 	end
+
+	-- sets the capacity of the pipe `no` is an end of. the kernel rounds `size`
+	-- up to a power of 2 pages. returns the capacity set
+	_.pipe_size = function(no, size)
+		return _.fcntl(no, C.F_SETPIPE_SZ, ffi.new("int", size))
+	end
+
+	-- while corked, a TCP socket only sends full frames. uncorking sends
+	-- whatever is held back
+	_.cork = function(no, on)
+		local err = _.setsockopt(no, C.IPPROTO_TCP, C.TCP_CORK, on and 1 or 0)
+		if err then return err end
+	end
 end
 
 
@@ -460,8 +484,8 @@ _.connect = function(no, endpoint)
 	return nil, no
 end
 
-_.setsockopt = function(no, level, name)
-	local on = ffi.new("int32_t[1]", 1)
+_.setsockopt = function(no, level, name, value)
+	local on = ffi.new("int32_t[1]", value or 1)
 	local rc = C.setsockopt(no, level, name, on, ffi.sizeof(on))
 	if rc < 0 then return errors.get(ffi.errno()) end
 	return nil, no
@@ -498,6 +522,28 @@ _.accept = function(no)
 end
 
 
+-- accepts a connection which is already non-blocking and close-on-exec
+if ffi.os:lower() == "linux" then
+	local flags = bit.bor(C.SOCK_NONBLOCK, C.SOCK_CLOEXEC)
+
+	_.accept_nonblock = function(no)
+		local no = C.accept4(no, nil, nil, flags)
+		if no < 0 then return errors.get(ffi.errno()) end
+		return nil, no
+	end
+else
+	_.accept_nonblock = function(no)
+		local no = C.accept(no, nil, nil)
+		if no < 0 then return errors.get(ffi.errno()) end
+		local err = _.fcntl_nonblock(no)
+		if err then C.close(no); return err end
+		local err = _.fcntl(no, C.F_SETFD, ffi.new("int", C.FD_CLOEXEC))
+		if err then C.close(no); return err end
+		return nil, no
+	end
+end
+
+
 _.getrusage = function(who)
 	who = who or C.RUSAGE_SELF
 	local rusage = ffi.new("struct rusage")
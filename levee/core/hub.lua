@@ -164,7 +164,7 @@ function Trace_mt:patch()
 	self.r.hub.spawn = function(hub, f, a)
 		local co = coroutine.create(f)
 		self:capture(f, co)
-		hub.ready:push({co, a})
+		hub.ready:push(co, a)
 		hub:continue()
 	end
 
@@ -343,9 +343,22 @@ function Hub_mt:_coyield(co, err, sender, value)
 end
 
 
+-- the hub's clock in ms, as used for timers. it's monotonic and cached once
+-- per loop iteration, so it's cheap to call
+function Hub_mt:now()
+	return tonumber(self.poller:abstime(0))
+end
+
+
+-- the wall clock in seconds, cached once per loop iteration
+function Hub_mt:time()
+	return self.poller:time()
+end
+
+
 function Hub_mt:spawn(f, a)
 	local co = coroutine.create(f)
-	self.ready:push({co, a})
+	self.ready:push(co, a)
 	self:continue()
 end
 
@@ -385,12 +398,12 @@ end
 
 
 function Hub_mt:resume(co, err, sender, value)
-	self.ready:push({co, err, sender, value})
+	self.ready:push(co, err, sender, value)
 end
 
 
 function Hub_mt:continue()
-	self.ready:push({coroutine.running()})
+	self.ready:push(coroutine.running())
 	self:_coyield()
 end
 
@@ -420,27 +433,37 @@ function Hub_mt:register_nopoll(no, r, w)
 end
 
 
-function Hub_mt:unregister(no)
+local function unregister(self, no)
 	local r = self.registered[no]
-	if r then
-		table.insert(self.closing, no)
+	if not r then return end
 
-		-- this is only needed if a platform doesn't remove an fd from a poller on
-		-- fd close
-		-- TODO: detect r, w
-		-- self.poller:unregister(no, r, w)
+	-- epoll and kqueue drop an fd once it's closed, but io_uring's polls hold
+	-- a reference to the file until they're removed
+	self.poller:unregister(no)
 
-		if r[1] then r[1]:set(-1) end
-		if r[2] then r[2]:set(-1) end
-		self.registered[no] = nil
-	end
+	if r[1] then r[1]:set(-1) end
+	if r[2] then r[2]:set(-1) end
+	self.registered[no] = nil
+	return true
+end
+
+
+function Hub_mt:unregister(no)
+	if unregister(self, no) then table.insert(self.closing, no) end
+end
+
+
+-- stops polling an fd that's owned elsewhere, without closing it
+function Hub_mt:unregister_keep(no)
+	unregister(self, no)
 end
 
 
 function Hub_mt:in_use()
 	for no in pairs(self.registered) do
-		if not self.dialer.state or
-			(no ~= self.dialer.r and no ~= self.dialer.state.io[1]) then
+		if (not self.dialer.state or no ~= self.dialer.r) and
+				no ~= self.dns.no and not self.io.pipes.idle[no] and
+				not self.thread.spaces[no] then
 			return true
 		end
 	end
@@ -451,8 +474,7 @@ end
 function Hub_mt:pump()
 	local num = #self.ready
 	for _ = 1, num do
-		local co, err, sender, value = unpack(self.ready:pop())
-		self:_coresume(co, err, sender, value)
+		self:_coresume(self.ready:pop())
 	end
 
 	local timeout
@@ -472,12 +494,10 @@ function Hub_mt:pump()
 	local err, events, n = self.poller:poll(timeout)
 	assert(not err)
 
+	local now = self.poller:abstime(0)
 	while true do
-		local timeout = self.scheduled:peek()
-		if not timeout or self.poller:reltime(timeout) > 0 then
-			break
-		end
-		local ms, co = self.scheduled:pop()
+		local ms, co = self.scheduled:expire(now)
+		if not ms then break end
 		self:_coresume(co, errors.TIMEOUT)
 	end
 
@@ -518,11 +538,21 @@ local function Hub(options)
 
 	local self = setmetatable({}, Hub_mt)
 
-	self.ready = d.Fifo()
-	self.scheduled = d.Heap()
+	self.poller = _.poller(options.poller)
+	-- events per poll. with poll_batch_max the batch adapts to the load
+	if (options.poll_batch or options.poll_batch_max) and self.poller.batch then
+		self.poller:batch(options.poll_batch or 64, options.poll_batch_max)
+	end
+	self.ready = d.Ring(options.ready_size)
+	-- timers are kept in a binary heap by default; a timer wheel makes adding
+	-- and cancelling a timer O(1), which suits many short lived timeouts
+	if options.timers == "wheel" then
+		self.scheduled = d.Wheel(self.poller:abstime(0))
+	else
+		self.scheduled = d.Heap()
+	end
 
 	self.registered = {}
-	self.poller = _.poller()
 	self.closing = {}
 
 	self._pcoro = coroutine.running()
@@ -535,18 +565,18 @@ local function Hub(options)
 		end
 	end)
 
-	self.io = require("levee.core.io")(self)
+	self.io = require("levee.core.io")(self, options.io)
 	self.signal = require("levee.core.signal")(self)
 	self.process = require("levee.core.process")(self)
-	self.thread = require("levee.core.thread")(self)
+	self.thread = require("levee.core.thread")(self, options.channel_capacity)
 
 	self.stream = require("levee.net.stream")(self)
 	self.dgram = require("levee.net.dgram")(self)
-	self.dialer = require("levee.net.dialer")(self)
-	self.dns = require("levee.net.dns")(self)
+	self.dialer = require("levee.net.dialer")(self, options.dialer)
+	self.dns = require("levee.net.dns")(self, options.dns)
 	self.tcp = self.stream
 
-	self.http = require("levee.p.http")(self)
+	self.http = require("levee.p.http")(self, options.http)
 	self.consul = require("levee.app.consul")(self)
 
 	self.trace = Trace(self)
@@ -12,6 +12,9 @@ local p = require("levee.p")
 local MIN_SPLICE_SIZE = 4 * _.pagesize
 
 
+local ctype_mirror = ffi.typeof("LeveeMirror")
+
+
 --
 -- Protocol conveniences for R / W / RW
 --
@@ -32,6 +35,10 @@ end
 
 
 function P_mt:readin(n)
+	if #self.rbuf == 0 and self.wbuf and #self.wbuf == 0 and self.hub.io.scratch then
+		-- waiting on the peer, so the write buffer's block can go back as well
+		self.wbuf:release()
+	end
 	return self.io:readinto(self.rbuf, n)
 end
 
@@ -184,7 +191,11 @@ local R_mt = {}
 function R_mt.__index(self, key)
 	if key == "p" then
 		self.p = setmetatable(
-			{hub=self.hub, io=self, options=self.options, rbuf=d.Buffer(4096)}, P_mt)
+			{
+				hub=self.hub,
+				io=self,
+				options=self.options,
+				rbuf=self.hub.io:buffer(), }, P_mt)
 		return self.p
 	end
 	return R_mt[key]
@@ -235,6 +246,19 @@ function R_mt:readinto(buf, n)
 		local ptr, len = buf:tail()
 		err, read = self:readn(ptr, needed, len)
 
+	elseif #buf == 0 and self.hub.io.scratch and
+			not ffi.istype(ctype_mirror, buf) then
+		-- with nothing buffered, hand the buffer's block back and read into the
+		-- hub's scratch block instead. a connection waiting on a read then
+		-- holds no memory of its own, and its buffer is sized to what arrives.
+		-- mirrors are left be, as mapping them is far dearer than a malloc
+		buf:release()
+		local scratch, size = self.hub.io:_scratch()
+		err, read = self:read(scratch, size)
+		if err then return err end
+		buf:ensure(read)
+		ffi.copy(buf:tail(), scratch, read)
+
 	else
 		buf:ensure()
 		err, read = self:read(buf:tail())
@@ -254,7 +278,17 @@ function R_mt:reads(len)
 end
 
 
+-- buffered writes to `to` are flushed before anything is written to its fd
+-- directly. that includes bytes a flush in progress has swapped out of `out`
+local function flush_target(to)
+	if to.out then return to:flush() end
+end
+
+
 function R_mt:sendfile(to, len, off)
+	local err = flush_target(to)
+	if err then return err end
+
 	local remain = len
 	off = off or 0
 
@@ -280,6 +314,9 @@ if _.splice then
 	function R_mt:_splice(to, len)
 		if self.closed then return errors.CLOSED end
 
+		local err = flush_target(to)
+		if err then return err end
+
 		local err, n = _.splice(self.no, to.no, len)
 
 		if not err and n > 0 then return nil, n end
@@ -300,6 +337,9 @@ if _.tee then
 	function R_mt:_tee(to, len)
 		if self.closed then return errors.CLOSED end
 
+		local err = flush_target(to)
+		if err then return err end
+
 		local err, n = _.tee(self.no, to.no, len)
 
 		if not err and n > 0 then return nil, n end
@@ -321,6 +361,37 @@ function R_mt:stream()
 end
 
 
+-- returns the bytes held by the connection's buffers: `read` for its
+-- protocol read buffer, `write` for its protocol write buffer and buffered
+-- writes, and their `total`
+function R_mt:memory()
+	local read, write = 0, 0
+	local p = rawget(self, "p")
+	if p then
+		if p.rbuf then read = read + p.rbuf.cap end
+		if p.wbuf then write = write + p.wbuf.cap end
+	end
+	if self.out then write = write + self.out.cap + self.out_back.cap end
+	return {read=read, write=write, total=read + write}
+end
+
+
+-- gives back the blocks of any of the connection's buffers that are empty.
+-- returns the bytes freed
+function R_mt:release()
+	local freed = 0
+	local p = rawget(self, "p")
+	if p then
+		if p.rbuf then freed = freed + p.rbuf:release() end
+		if p.wbuf then freed = freed + p.wbuf:release() end
+	end
+	if self.out and not self.out_flushing then
+		freed = freed + self.out:release() + self.out_back:release()
+	end
+	return freed
+end
+
+
 function R_mt:close()
 	if self.closed then
 		return errors.CLOSED
@@ -347,7 +418,7 @@ local W_mt = {}
 function W_mt.__index(self, key)
 	if key == "p" then
 		self.p = setmetatable(
-			{hub=self.hub, io=self, options=self.options, wbuf=d.Buffer(4096)}, P_mt)
+			{hub=self.hub, io=self, options=self.options, wbuf=d.Buffer()}, P_mt)
 		return self.p
 	end
 	return W_mt[key]
@@ -355,6 +426,34 @@ end
 
 
 W_mt.stat = R_mt.stat
+W_mt.memory = R_mt.memory
+W_mt.release = R_mt.release
+
+
+-- writes all `len` bytes at `src`, waiting on the fd to become writable as
+-- needed. closes the fd on error
+function W_mt:_write(src, len)
+	local sent = 0
+
+	while true do
+		local err, n = _.write(self.no, src + sent, len - sent)
+		if self.out_stats then self.out_stats.syscalls = self.out_stats.syscalls + 1 end
+
+		if err and not err.is_system_EAGAIN then
+			self:close()
+			return err
+		end
+
+		if err or n < 0 then n = 0 end
+		sent = sent + n
+		if sent == len then break end
+		local err = self.w_ev:recv()
+		if err then
+			self:close()
+			return err
+		end
+	end
+end
 
 
 function W_mt:write(buf, len)
@@ -364,6 +463,8 @@ function W_mt:write(buf, len)
 		len = #buf
 	end
 
+	if self.out then return self:_buffer(buf, len) end
+
 	local src
 
 	if type(buf) == "string" then
@@ -372,34 +473,136 @@ function W_mt:write(buf, len)
 		src = buf
 	end
 
-	local sent = 0
+	local err = self:_write(src, len)
+	if err then return err end
 
-	while true do
-		local err, n = _.write(self.no, src + sent, len - sent)
+	self.hub:continue()
+	return nil, len
+end
 
-		if err and not err.is_system_EAGAIN then
-			self:close()
-			return err
+
+--
+-- Buffered writes
+
+-- In buffered mode writes are copied to a buffer instead of being written
+-- straight away, and return without yielding. The buffer is flushed once it
+-- holds `threshold` bytes, on flush(), and otherwise at the end of the current
+-- tick of the hub, so a response written as a status line, headers and a body
+-- goes out in a single syscall.
+
+function W_mt:buffered(threshold)
+	if self.closed then return errors.CLOSED end
+	if self.out then return end
+
+	self.out = d.Buffer(4096)
+	-- the buffer being written while a flush waits on the fd
+	self.out_back = d.Buffer(4096)
+	self.out_threshold = threshold or 65536
+	-- counted, as the main thread's entry is nil
+	self.out_waiters = {}
+	self.out_nwaiters = 0
+	self.out_stats = {writes=0, flushes=0, syscalls=0, bytes=0}
+
+	local sender, recver = self.hub:flag()
+	self.out_tick = sender
+	self.hub:spawn(function()
+		while true do
+			local err = recver:recv()
+			if err then return end
+			self.out_pending = false
+			self:flush()
 		end
+	end)
+end
 
-		if err or n < 0 then n = 0 end
-		sent = sent + n
-		if sent == len then break end
-		local err = self.w_ev:recv()
-		if err then
-			self:close()
-			return err
+
+function W_mt:_buffer(buf, len)
+	self.out:write(buf, len)
+	self.out_stats.writes = self.out_stats.writes + 1
+	self.out_stats.bytes = self.out_stats.bytes + len
+
+	if not self.out_pending then
+		self.out_pending = true
+		self.out_tick:send(true)
+	end
+
+	if #self.out >= self.out_threshold then
+		-- more is likely on its way, so only send full frames until the end of
+		-- the tick, when the flush uncorks
+		if _.cork and not self.out_corked and self.out_cork ~= false then
+			self.out_cork = not _.cork(self.no, true)
+			self.out_corked = self.out_cork
+			self.out_stats.syscalls = self.out_stats.syscalls + 1
 		end
+		local err = self:flush()
+		if err then return err end
 	end
 
-	self.hub:continue()
 	return nil, len
 end
 
 
+-- writes out anything buffered. returns once it's been written
+function W_mt:flush()
+	if self.closed then return errors.CLOSED end
+	if not self.out then return end
+
+	if self.out_flushing then
+		-- another green thread is flushing, and it keeps going until the buffer
+		-- is empty. wait for it so the bytes go out in order
+		self.out_nwaiters = self.out_nwaiters + 1
+		self.out_waiters[self.out_nwaiters] = coroutine.running()
+		local err = self.hub:pause()
+		return err
+	end
+
+	local err
+	-- the flushing green thread, or true for the main thread
+	self.out_flushing = coroutine.running() or true
+	while #self.out > 0 do
+		local buf = self.out
+		self.out, self.out_back = self.out_back, buf
+		self.out_stats.flushes = self.out_stats.flushes + 1
+		err = self:_write(buf:value())
+		buf:trim()
+		buf:release()
+		if err then break end
+	end
+	self.out_flushing = false
+	self.out:release()
+
+	if not err and self.out_corked and not self.out_pending then
+		self.out_corked = false
+		_.cork(self.no, false)
+		self.out_stats.syscalls = self.out_stats.syscalls + 1
+	end
+
+	local waiters, n = self.out_waiters, self.out_nwaiters
+	if n > 0 then
+		self.out_waiters = {}
+		self.out_nwaiters = 0
+		for i = 1, n do self.hub:resume(waiters[i], err) end
+	end
+
+	return err
+end
+
+
+-- returns counts of `writes` and the `bytes` written, the `flushes` of the
+-- buffer and the `syscalls` made to do so, for a connection in buffered mode
+function W_mt:wstats()
+	return self.out_stats
+end
+
+
 function W_mt:writev(iov, n)
 	if self.closed then return errors.CLOSED end
 
+	if self.out then
+		local err = self:flush()
+		if err then return err end
+	end
+
 	local len
 	local i, total = 0, 0
 
@@ -505,11 +708,27 @@ function W_mt:send_msgpack(data)
 end
 
 
+function W_mt:_close_buffered()
+	if not self.out then return end
+	-- wait out a flush in progress, unless it's the flush itself that's
+	-- closing after a failed write
+	local flusher = self.out_flushing
+	if flusher ~= (coroutine.running() or true) and
+			(flusher or #self.out > 0) then
+		self:flush()
+	end
+	self.out_tick:close()
+end
+
+
 function W_mt:close()
 	if self.closed then
 		return errors.CLOSED
 	end
 
+	self:_close_buffered()
+	-- the final flush may have failed and closed the fd already
+	if self.closed then return end
 	self.closed = true
 	if self.iovec then
 		self.iovec:close()
@@ -533,8 +752,8 @@ function RW_mt.__index(self, key)
 			hub=self.hub,
 			io=self,
 			options=self.options,
-			rbuf=d.Buffer(4096),
-			wbuf=d.Buffer(4096),
+			rbuf=self.hub.io:buffer(),
+			wbuf=d.Buffer(),
 			}, P_mt)
 		return self.p
 	end
@@ -550,7 +769,15 @@ RW_mt.stream = R_mt.stream
 RW_mt._splice = R_mt._splice
 RW_mt._tee = R_mt._tee
 RW_mt.stat = R_mt.stat
+RW_mt.memory = R_mt.memory
+RW_mt.release = R_mt.release
+RW_mt._write = W_mt._write
 RW_mt.write = W_mt.write
+RW_mt.buffered = W_mt.buffered
+RW_mt._buffer = W_mt._buffer
+RW_mt.flush = W_mt.flush
+RW_mt.wstats = W_mt.wstats
+RW_mt._close_buffered = W_mt._close_buffered
 RW_mt.writev = W_mt.writev
 RW_mt.iov = W_mt.iov
 RW_mt.send = W_mt.send
@@ -562,6 +789,9 @@ function RW_mt:close()
 		return
 	end
 
+	self:_close_buffered()
+	-- the final flush may have failed and closed the fd already
+	if self.closed then return end
 	self.closed = true
 	if self.iovec then
 		self.iovec:close()
@@ -688,7 +918,7 @@ end
 function Stream(conn)
 	local self = setmetatable({}, Stream_mt)
 	self.conn = conn
-	self.buf = d.Buffer(4096)
+	self.buf = conn.hub.io:buffer(4096)
 	return self
 end
 
@@ -788,7 +1018,7 @@ function Chunk_mt:_splice_0copy(target)
 	local len = self.len
 
 	local buf, buflen = self:value()
-	if self.len - buflen < MIN_SPLICE_SIZE then
+	if self.len - buflen < self.hub.io.splice_min then
 		return self:_splice(target)
 	end
 
@@ -799,7 +1029,7 @@ function Chunk_mt:_splice_0copy(target)
 		self:trim()
 	end
 
-	local r, w = self.hub.io:pipe()
+	local r, w = self.hub.io.pipes:get()
 	local source = self.stream.conn
 
 	-- wire splice r, w pairs' evs together
@@ -827,11 +1057,11 @@ function Chunk_mt:_splice_0copy(target)
 	end
 
 	::cleanup::
-	-- restore target and temp w's w_ev
+	-- restore target and the pipe's w_ev
 	target.w_ev.set = target_w_ev_set
-	w.w_ev.set = target_w_ev_set
-	r:close()
-	w:close()
+	w.w_ev.set = nil
+	-- after an error the pipe may still hold bytes, so it isn't reused
+	self.hub.io.pipes:put(r, w, err)
 
 	if err then return err end
 
@@ -944,7 +1174,7 @@ function Chunk_mt:_tee_0copy(...)
 	local total = self.len
 
 	local buf, len = self:value()
-	if self.len - len < MIN_SPLICE_SIZE then
+	if self.len - len < self.hub.io.splice_min then
 		return self:_tee(...)
 	end
 
@@ -1126,6 +1356,90 @@ function IO_mt:pipe(timeout)
 end
 
 
+--
+-- Pipe pool
+
+-- splice moves bytes between two fds through a pipe. rather than opening a
+-- pair for each chunk spliced, a hub keeps a pool of idle pairs to check out
+-- and return. idle pairs stay registered with the hub, but don't count
+-- towards it being in use.
+
+local Pipes_mt = {}
+Pipes_mt.__index = Pipes_mt
+
+
+function Pipes_mt:get()
+	local pair = table.remove(self.free)
+	if pair then
+		self.hits = self.hits + 1
+		self.idle[pair[1].no] = nil
+		self.idle[pair[2].no] = nil
+		return pair[1], pair[2]
+	end
+
+	self.misses = self.misses + 1
+	local r, w = self.io:pipe()
+	if self.size and _.pipe_size then
+		-- keep the default capacity if the size asked for isn't allowed
+		_.pipe_size(w.no, self.size)
+	end
+	return r, w
+end
+
+
+-- returns a pair to the pool. pairs that are closed, `dirty` or that don't
+-- fit in the pool are closed instead
+function Pipes_mt:put(r, w, dirty)
+	if dirty or r.closed or w.closed or #self.free >= self.max then
+		self.drops = self.drops + 1
+		r:close()
+		w:close()
+		return
+	end
+
+	self.puts = self.puts + 1
+	self.idle[r.no] = true
+	self.idle[w.no] = true
+	table.insert(self.free, {r, w})
+end
+
+
+-- closes every idle pair
+function Pipes_mt:clear()
+	while #self.free > 0 do
+		local pair = table.remove(self.free)
+		self.idle[pair[1].no] = nil
+		self.idle[pair[2].no] = nil
+		pair[1]:close()
+		pair[2]:close()
+	end
+end
+
+
+function Pipes_mt:stats()
+	return {
+		idle = #self.free,
+		hits = self.hits,
+		misses = self.misses,
+		puts = self.puts,
+		drops = self.drops, }
+end
+
+
+local function Pipes(io, max, size)
+	return setmetatable({
+		io = io,
+		max = max,
+		size = size,
+		free = {},
+		idle = {},
+		hits = 0,
+		misses = 0,
+		puts = 0,
+		drops = 0, }, Pipes_mt)
+end
+
+
 function IO_mt:open(name, oflag, mode)
 	local err, no, oflag = _.open(name, oflag, mode)
 	if err then return err end
@@ -1167,6 +1481,26 @@ function IO_mt:stdout()
 end
 
 
+-- returns a buffer for reads to fill. with the mirror option, this is a
+-- d.Mirror, so trimming parsed messages off the front never moves what's left
+function IO_mt:buffer(hint)
+	if self.mirror then return d.Mirror(hint) end
+	return d.Buffer(hint)
+end
+
+
+-- the block reads into empty buffers go through, see R:readinto
+local SCRATCH_SIZE = 65536
+
+
+function IO_mt:_scratch()
+	if not self.scratch_buf then
+		self.scratch_buf = ffi.new("char[?]", SCRATCH_SIZE)
+	end
+	return self.scratch_buf, SCRATCH_SIZE
+end
+
+
 IO_mt.iovec = d.Iovec
 IO_mt.R_mt = R_mt
 IO_mt.W_mt = W_mt
@@ -1176,6 +1510,12 @@ IO_mt.Chunk_mt = Chunk_mt
 IO_mt.P_mt = P_mt
 
 
-return function(hub)
-	return setmetatable({hub = hub}, IO_mt)
+return function(hub, options)
+	options = options or {}
+	local self = setmetatable({hub = hub}, IO_mt)
+	self.scratch = options.scratch ~= false
+	self.mirror = options.mirror and d.Mirror:supported() or false
+	self.splice_min = options.splice_min or MIN_SPLICE_SIZE
+	self.pipes = Pipes(self, options.pipe_pool or 16, options.pipe_size)
+	return self
 end
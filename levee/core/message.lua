@@ -368,6 +368,11 @@ Queue_mt.__index = Queue_mt
 Queue_mt.__call = Recver_mt.__call
 
 
+function Queue_mt:__len()
+	return #self.fifo
+end
+
+
 function Queue_mt:_give(err, sender, value)
 	if self.closed then return errors.CLOSED end
 
@@ -38,7 +38,9 @@ function Recver_mt:pump(node)
 		err = errors.get(node.error)
 	end
 
-	if node.type == C.LEVEE_CHAN_NIL then
+	if node.type == C.LEVEE_CHAN_EOF then
+		self.queue.sender:close()
+	elseif node.type == C.LEVEE_CHAN_NIL then
 		self.queue:pass(err, nil)
 	elseif node.type == C.LEVEE_CHAN_PTR then
 		local err, data
@@ -124,8 +126,10 @@ function Sender_mt:pass(err, val)
 	elseif type(val) == "boolean" then
 		return C.levee_chan_send_bool(self, err, val)
 	elseif ffi.istype(ctype_buf, val) then
-		ffi.gc(val, nil)  -- cancel the buffer's local gc
-		return C.levee_chan_send_buf(self, err, val)
+		local rc = C.levee_chan_send_buf(self, err, val)
+		-- once sent, the buffer belongs to the receiver
+		if rc >= 0 then ffi.gc(val, nil) end
+		return rc
 	elseif ffi.istype(ctype_ptr, val) then
 		local rc = C.levee_chan_send_ptr(self, err,
 			val.val, val.len, C.LEVEE_CHAN_RAW)
@@ -173,13 +177,55 @@ end
 
 
 function Sender_mt:close()
-	C.levee_chan_sender_close()
+	C.levee_chan_sender_close(self)
 end
 
 
 ffi.metatype("LeveeChanSender", Sender_mt)
 
 
+--
+-- Blocking Sender
+
+-- Wraps a channel sender for use from a hub. A send to a channel that is at
+-- capacity pauses the current green thread until the receiver drains, instead
+-- of failing with EAGAIN.
+
+local Blocking_mt = {}
+Blocking_mt.__index = Blocking_mt
+
+
+function Blocking_mt:__tostring()
+	return tostring(self.sender)
+end
+
+
+function Blocking_mt:pass(err, val)
+	while true do
+		local rc = self.sender:pass(err, val)
+		if rc ~= -1 or not errors.get(ffi.errno()).is_system_EAGAIN then
+			return rc
+		end
+		if not self.hub.thread:_space(self.sender.chan) then return rc end
+	end
+end
+
+
+function Blocking_mt:send(val)
+	return self:pass(nil, val)
+end
+
+
+function Blocking_mt:connect(chan)
+	return self.sender:connect(chan)
+end
+
+
+function Blocking_mt:close()
+	return self.sender:close()
+end
+
+
 local Channel_mt = {}
 Channel_mt.__index = Channel_mt
 
@@ -199,6 +245,18 @@ function Channel_mt:close()
 end
 
 
+function Channel_mt:stats()
+	local stats = ffi.new("LeveeChanStats")
+	if C.levee_chan_stats(self.chan, stats) < 0 then return end
+	return {
+		notifies = tonumber(stats.notifies),
+		capacity = tonumber(stats.capacity),
+		depth = tonumber(stats.depth),
+		high_water = tonumber(stats.high_water),
+		refused = tonumber(stats.refused), }
+end
+
+
 function Channel_mt:bind()
 	local id = tonumber(C.levee_chan_next_recv_id(self.chan))
 	if id < 0 then
@@ -227,8 +285,8 @@ function Channel_mt:pump()
 end
 
 
-local function Channel(hub)
-	local chan = C.levee_chan_create(hub.poller.fd)
+local function Channel(hub, capacity)
+	local chan = C.levee_chan_create(hub.poller.fd, capacity or 0)
 	if chan == nil then
 		error("levee_chan_create")
 	end
@@ -355,12 +413,56 @@ Thread_mt.__index = Thread_mt
 
 function Thread_mt:channel()
 	if self.chan == nil then
-		self.chan = Channel(self.hub)
+		self.chan = Channel(self.hub, self.capacity)
 	end
 	return self.chan
 end
 
 
+function Thread_mt:sender(sender)
+	return setmetatable({hub = self.hub, sender = sender}, Blocking_mt)
+end
+
+
+-- pauses the current green thread until the channel referenced by chan has
+-- space for refused senders to retry. returns false if the channel is
+-- unbounded.
+--
+-- the space pipe belongs to the channel, so it's only registered with this
+-- hub while senders are waiting on it. a single watcher wakes every waiting
+-- sender each time the pipe fires; those refused again wait for the next.
+function Thread_mt:_space(chan)
+	local no = C.levee_chan_space_id(chan)
+	if no < 0 then return false end
+
+	local space = self.spaces[no]
+	if not space then
+		space = {waiters = {}, ev = self.hub:register(no, true)}
+		self.spaces[no] = space
+		self.hub:spawn_later(0, function() self:_watch_space(no, space) end)
+	end
+
+	table.insert(space.waiters, coroutine.running())
+	self.hub:pause()
+	return true
+end
+
+
+function Thread_mt:_watch_space(no, space)
+	while #space.waiters > 0 do
+		local err, sender, value = space.ev:recv()
+		local waiters = space.waiters
+		space.waiters = {}
+		for __, co in ipairs(waiters) do self.hub:resume(co) end
+		if err or (value and value < 0) then break end
+		-- let the woken senders retry before checking who's still waiting
+		self.hub:continue()
+	end
+	self.spaces[no] = nil
+	self.hub:unregister_keep(no)
+end
+
+
 function Thread_mt:call(f, ...)
 	local state = State()
 
@@ -393,19 +495,20 @@ function Thread_mt:call(f, ...)
 end
 
 
-function Thread_mt:spawn(f)
+function Thread_mt:spawn(f, ...)
 	local state = State()
 
 	-- bootstrap
 	assert(state:load_function(
-		function(sender, f)
+		function(sender, f, ...)
 			local levee = require("levee")
 			local message = require("levee.core.message")
 
 			local h = levee.Hub()
-			h.parent = message.Pair(sender, sender:connect(h.thread:channel()))
+			h.parent = message.Pair(
+				h.thread:sender(sender), sender:connect(h.thread:channel()))
 
-			local ok, got = pcall(loadstring(f), h)
+			local ok, got = pcall(loadstring(f), h, ...)
 
 			if not ok then
 				-- TODO: we should work an optional error message into Pipe close
@@ -419,14 +522,19 @@ function Thread_mt:spawn(f)
 		state:push(recver:create_sender())
 
 		state:push(string.dump(f))
-		state:run(2, true)
+
+		local args = {...}
+		for i = 1, #args do
+			state:push(args[i])
+		end
+		state:run(2 + #args, true)
 
 		local err, sender = recver:recv()
 		assert(not err)
-		return message.Pair(sender, recver)
+		return message.Pair(self:sender(sender), recver)
 end
 
 
-return function(hub)
-	return setmetatable({hub = hub}, Thread_mt)
+return function(hub, capacity)
+	return setmetatable({hub = hub, capacity = capacity, spaces = {}}, Thread_mt)
 end
@@ -43,6 +43,11 @@ function Butt_mt:trim(n)
 end
 
 
+function Butt_mt:release()
+	return self.buf:release()
+end
+
+
 function Butt_mt:ensure(...)
 	return self.buf:ensure(...)
 end
@@ -92,10 +97,28 @@ function Buffer_mt:truncate()
 end
 
 
+-- rounds `cap` up to the size of block that would hold it
+local function blocksize(cap)
+	if cap <= C.LEVEE_BUFFER_MIN_SIZE then
+		return C.LEVEE_BUFFER_MIN_SIZE
+	elseif cap >= C.LEVEE_BUFFER_MAX_BLOCK then
+		-- grow to nearest LEVEE_BUFFER_MAX_BLOCK size with capacity to hold hint
+		return (
+			((cap - 1) / C.LEVEE_BUFFER_MAX_BLOCK) + 1) * C.LEVEE_BUFFER_MAX_BLOCK
+	end
+	-- grow to nearest power of 2
+	return math.pow(2, math.ceil(math.log(cap)/math.log(2)))
+end
+
+
 function Buffer_mt:ensure(hint)
 	if not hint then
 		-- ensure we have *some* space to read into
-		hint = self.cap / 2 < 65536ULL and self.cap / 2 or 65536ULL
+		if self.cap == 0 then
+			hint = C.LEVEE_BUFFER_MIN_SIZE
+		else
+			hint = self.cap / 2 < 65536ULL and self.cap / 2 or 65536ULL
+		end
 	end
 
 	local cap = self.sav + self.len + hint
@@ -115,28 +138,19 @@ function Buffer_mt:ensure(hint)
 	local buf
 
 	-- find next capacity size
-	if cap <= C.LEVEE_BUFFER_MIN_SIZE then
-		cap = C.LEVEE_BUFFER_MIN_SIZE
-	elseif cap >= C.LEVEE_BUFFER_MAX_BLOCK then
-		-- grow to nearest LEVEE_BUFFER_MAX_BLOCK size with capacity to hold hint
-		cap = (
-			((cap - 1) / C.LEVEE_BUFFER_MAX_BLOCK) + 1) * C.LEVEE_BUFFER_MAX_BLOCK
-	else
-		-- grow to nearest power of 2
-		cap = math.pow(2, math.ceil(math.log(cap)/math.log(2)))
-	end
+	cap = blocksize(cap)
 
 	local sav = self.sav
 	if sav > 0 then self:thaw() end
 
-	if self.off > 0 or cap < C.LEVEE_BUFFER_MAX_BLOCK then
-		buf = C.malloc(cap)
+	if self.off > 0 or cap <= C.LEVEE_BUFFER_MAX_BLOCK then
+		buf = C.levee_buffer_pool_get(cap)
 		if buf == nil then error(tostring(errors.get(ffi.errno()))) end
 		if self.len > 0 then
 			-- only copy the subregion containing untrimmed data
 			C.memcpy(buf, self.buf+self.off, self.len)
 		end
-		C.free(self.buf)
+		C.levee_buffer_pool_put(self.buf, self.cap)
 	else
 		-- use realloc to take advantage of mremap
 		buf = C.realloc(self.buf, cap)
@@ -154,6 +168,43 @@ function Buffer_mt:ensure(hint)
 end
 
 
+-- moves the buffer's contents to the smallest block that holds them, and at
+-- least `cap` bytes. an empty buffer gives its block back, see release.
+-- returns the bytes freed
+function Buffer_mt:shrink(cap)
+	if self.sav > 0 or self.cap == 0 then return 0 end
+	if self.len == 0 and not cap then return self:release() end
+
+	cap = blocksize(math.max(self.len, cap or 0))
+	if cap >= self.cap then return 0 end
+
+	local buf = C.levee_buffer_pool_get(cap)
+	if buf == nil then return 0 end
+	if self.len > 0 then C.memcpy(buf, self.buf + self.off, self.len) end
+	C.levee_buffer_pool_put(self.buf, self.cap)
+
+	local freed = self.cap - cap
+	self.buf = buf
+	self.off = 0
+	self.cap = cap
+	return freed
+end
+
+
+-- hands an empty buffer's block back to the pool, so an idle buffer costs
+-- nothing but its header. the next ensure borrows a block again. returns the
+-- bytes freed
+function Buffer_mt:release()
+	if self.len > 0 or self.sav > 0 or self.cap == 0 then return 0 end
+	C.levee_buffer_pool_put(self.buf, self.cap)
+	local freed = self.cap
+	self.buf = nil
+	self.off = 0
+	self.cap = 0
+	return freed
+end
+
+
 function Buffer_mt:available()
 	return self.cap - (self.off + self.len + self.sav)
 end
@@ -284,7 +335,8 @@ end
 
 
 local function cleanup(buf)
-	C.free(buf.buf)
+	-- hand the block back to the shared pool, from whichever thread now owns it
+	C.levee_buffer_pool_put(buf.buf - buf.sav, buf.cap)
 	C.free(buf)
 end
 
@@ -305,7 +357,8 @@ function M_mt.__call(M, hint)
 	buf.len = 0
 	buf.cap = 0
 	buf.sav = 0
-	buf:ensure(hint)
+	-- without a hint the first block is borrowed when it's first needed
+	if hint then buf:ensure(hint) end
 	return buf
 end
 
@@ -317,4 +370,29 @@ function M_mt.from_ptr(M, buf)
 end
 
 
+-- returns the process wide counters for the pool of blocks buffers grow into
+function M_mt.pool_stats(M)
+	local stats = ffi.new("LeveeBufferPoolStats")
+	C.levee_buffer_pool_stats(stats)
+	local hits, misses = tonumber(stats.hits), tonumber(stats.misses)
+	return {
+		hits = hits,
+		misses = misses,
+		hit_rate = hits + misses > 0 and hits / (hits + misses) or 0,
+		puts = tonumber(stats.puts),
+		drops = tonumber(stats.drops),
+		cached = tonumber(stats.cached),
+		bytes = tonumber(stats.bytes), }
+end
+
+
+-- frees every idle block held by the pool
+function M_mt.pool_clear(M)
+	C.levee_buffer_pool_clear()
+end
+
+
+M_mt.Buffer_mt = Buffer_mt
+
+
 return setmetatable({}, M_mt)
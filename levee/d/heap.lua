@@ -74,6 +74,15 @@ function Heap_mt:peek()
 end
 
 
+-- pops the lowest priority entry if its priority is at or below pri
+function Heap_mt:expire(pri)
+	local entry = C.levee_heap_get(self, C.LEVEE_HEAP_ROOT_KEY)
+	if entry ~= nil and entry.priority <= pri then
+		return self:pop()
+	end
+end
+
+
 function Heap_mt:clear()
 	REFS[castptr(self)] = {}
 	C.levee_heap_clear(self)
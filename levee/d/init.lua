@@ -1,9 +1,12 @@
 return {
 	Buffer = require("levee.d.buffer"),
+	Mirror = require("levee.d.mirror"),
 	Iovec = require("levee.d.iovec"),
 	Data = require("levee.d.data"),
 	Fifo = require("levee.d.fifo"),
+	Ring = require("levee.d.ring"),
 	Heap = require("levee.d.heap").Heap,
+	Wheel = require("levee.d.wheel").Wheel,
 	Set = require("levee.d.set"),
 	HashRing = require("levee.d.hashring"),
 }
@@ -0,0 +1,228 @@
+local ffi = require('ffi')
+local C = ffi.C
+
+
+local errors = require("levee.errors")
+local Buffer = require("levee.d.buffer")
+
+
+--
+-- Mirror
+
+-- A Mirror is a Buffer kept in a mirrored block, see levee_buffer_mirror_map.
+-- The block's pages are mapped twice in a row, so the buffer's contents can
+-- start anywhere in the first mapping and still be read as one contiguous
+-- region. trim only ever moves the offset forward, wrapping it back around
+-- the block, and the space it frees is immediately available at the tail.
+-- Unlike Buffer, contents are never moved down to reclaim trimmed space,
+-- which matters most for streams where many small messages arrive behind a
+-- partial one.
+--
+-- while frozen, the saved bytes start at `mark`, and trimmed bytes are left
+-- in place between them and `off` until thaw closes the gap. `off`, or `mark`
+-- while frozen, is always kept within the first mapping.
+
+local Mirror_mt = {}
+Mirror_mt.__index = Mirror_mt
+
+
+local pagesize = C.getpagesize()
+
+
+function Mirror_mt:__tostring()
+	return string.format(
+		"levee.d.Mirror: sav=%u, off=%u, len=%u, cap=%u",
+		self.sav, self.off, self.len, self.cap)
+end
+
+
+function Mirror_mt:__len()
+	return self.len
+end
+
+
+-- contents never need to be moved down, so this is a no-op. it's kept so a
+-- Mirror can stand in for a Buffer
+function Mirror_mt:truncate()
+end
+
+
+-- rounds `cap` up to the size of block that would hold it, a whole number of
+-- pages
+local function blocksize(cap)
+	if cap < C.LEVEE_BUFFER_MIN_SIZE then cap = C.LEVEE_BUFFER_MIN_SIZE end
+	if cap >= C.LEVEE_BUFFER_MAX_BLOCK then
+		cap = (
+			((cap - 1) / C.LEVEE_BUFFER_MAX_BLOCK) + 1) * C.LEVEE_BUFFER_MAX_BLOCK
+	else
+		cap = math.pow(2, math.ceil(math.log(cap)/math.log(2)))
+	end
+	return math.ceil(cap / pagesize) * pagesize
+end
+
+
+function Mirror_mt:ensure(hint)
+	if not hint then
+		-- ensure we have *some* space to read into
+		if self.cap == 0 then
+			hint = C.LEVEE_BUFFER_MIN_SIZE
+		else
+			hint = self.cap / 2 < 65536ULL and self.cap / 2 or 65536ULL
+		end
+	end
+
+	if self:available() >= hint then
+		if self.len == 0 and self.sav == 0 then self.off = 0 end
+		return self
+	end
+
+	local sav = self.sav
+	if sav > 0 then
+		-- closing the gap may free enough space
+		self:thaw()
+		if self:available() >= hint then
+			self:freeze(sav)
+			return self
+		end
+	end
+
+	local cap = blocksize(tonumber(self.len + hint))
+	local buf = C.levee_buffer_mirror_map(cap)
+	if buf == nil then error(tostring(errors.get(ffi.errno()))) end
+	if self.len > 0 then C.memcpy(buf, self.buf + self.off, self.len) end
+	C.levee_buffer_mirror_unmap(self.buf, self.cap)
+
+	self.buf = buf
+	self.off = 0
+	self.cap = cap
+
+	if sav > 0 then self:freeze(sav) end
+
+	return self
+end
+
+
+-- a Mirror's block can't be moved to a smaller one in place of its contents,
+-- so only an empty Mirror is shrunk, by releasing it. returns the bytes freed
+function Mirror_mt:shrink(cap)
+	if self.len == 0 and not cap then return self:release() end
+	return 0
+end
+
+
+-- unmaps an empty Mirror's block. the next ensure maps a new one. returns the
+-- bytes freed
+function Mirror_mt:release()
+	if self.len > 0 or self.sav > 0 or self.cap == 0 then return 0 end
+	C.levee_buffer_mirror_unmap(self.buf, self.cap)
+	local freed = self.cap
+	self.buf = nil
+	self.off = 0
+	self.cap = 0
+	return freed
+end
+
+
+function Mirror_mt:available()
+	if self.sav > 0 then
+		return self.cap - (self.off - self.mark + self.len)
+	end
+	return self.cap - self.len
+end
+
+
+function Mirror_mt:trim(len)
+	if not len or len > self.len then len = self.len end
+
+	self.off = self.off + len
+	self.len = self.len - len
+
+	if self.sav == 0 then
+		if self.len == 0 then
+			self.off = 0
+		elseif self.off >= self.cap then
+			-- wrap back around to the first mapping
+			self.off = self.off - self.cap
+		end
+	end
+
+	return len
+end
+
+
+function Mirror_mt:tail()
+	return self.buf + self.off + self.len, self:available()
+end
+
+
+function Mirror_mt:freeze(len)
+	assert(len <= self.len)
+	assert(self.sav == 0)
+	self.mark = self.off
+	self.sav = len
+	self.off = self.off + len
+	self.len = self.len - len
+end
+
+
+function Mirror_mt:thaw()
+	assert(self.sav > 0)
+	local saved = self.mark + self.sav
+	if self.off > saved and self.len > 0 then
+		-- close the gap left by anything trimmed while frozen
+		C.memmove(self.buf + saved, self.buf + self.off, self.len)
+	end
+	self.off = self.mark
+	self.len = self.len + self.sav
+	self.sav = 0
+end
+
+
+-- the rest only see the contents through `buf + off`, so are shared with
+-- Buffer
+for _, name in ipairs({
+		"bump", "slice", "value", "copy", "move", "peek", "take", "write",
+		"push", "writeinto_iovec", "butt", }) do
+	Mirror_mt[name] = Buffer.Buffer_mt[name]
+end
+
+
+local function cleanup(buf)
+	C.levee_buffer_mirror_unmap(buf.buf, buf.cap)
+	C.free(buf)
+end
+
+
+local mt = ffi.metatype("LeveeMirror", Mirror_mt)
+
+
+local M_mt = {}
+M_mt.__index = M_mt
+
+
+function M_mt.__call(M, hint)
+	local buf = C.malloc(ffi.sizeof(mt))
+	buf = ffi.cast("LeveeMirror*", buf)
+	buf = ffi.gc(buf, cleanup)
+	buf.buf = nil
+	buf.off = 0
+	buf.len = 0
+	buf.cap = 0
+	buf.sav = 0
+	buf.mark = 0
+	-- without a hint the block is mapped when it's first needed
+	if hint then buf:ensure(hint) end
+	return buf
+end
+
+
+-- returns true if mirrored blocks can be mapped on this system
+function M_mt.supported(M)
+	local block = C.levee_buffer_mirror_map(pagesize)
+	if block == nil then return false end
+	C.levee_buffer_mirror_unmap(block, pagesize)
+	return true
+end
+
+
+return setmetatable({}, M_mt)
@@ -0,0 +1,85 @@
+local new_tab = require("table.new")
+
+
+--
+-- Ring
+
+-- A Ring is a FIFO of up to 4 values per entry, stored in preallocated
+-- parallel arrays so pushing and popping an entry doesn't create a table. The
+-- ring doubles in size when full.
+
+local Ring_mt = {}
+Ring_mt.__index = Ring_mt
+
+
+function Ring_mt:push(a, b, c, d)
+	if self.n == self.size then self:_grow() end
+	local i = self.tail
+	self.a[i], self.b[i], self.c[i], self.d[i] = a, b, c, d
+	self.tail = bit.band(i, self.mask) + 1
+	self.n = self.n + 1
+end
+
+
+function Ring_mt:pop()
+	if self.n == 0 then error("empty") end
+	local i = self.head
+	local a, b, c, d = self.a[i], self.b[i], self.c[i], self.d[i]
+	self.a[i], self.b[i], self.c[i], self.d[i] = nil, nil, nil, nil
+	self.head = bit.band(i, self.mask) + 1
+	self.n = self.n - 1
+	return a, b, c, d
+end
+
+
+function Ring_mt:peek()
+	if self.n == 0 then error("empty") end
+	local i = self.head
+	return self.a[i], self.b[i], self.c[i], self.d[i]
+end
+
+
+function Ring_mt:_grow()
+	local size = self.size * 2
+	local a, b, c, d =
+		new_tab(size, 0), new_tab(size, 0), new_tab(size, 0), new_tab(size, 0)
+
+	local i = self.head
+	for j = 1, self.n do
+		a[j], b[j], c[j], d[j] = self.a[i], self.b[i], self.c[i], self.d[i]
+		i = bit.band(i, self.mask) + 1
+	end
+
+	self.a, self.b, self.c, self.d = a, b, c, d
+	self.head = 1
+	self.tail = self.n + 1
+	self.size = size
+	self.mask = size - 1
+end
+
+
+function Ring_mt:__len()
+	return self.n
+end
+
+
+function Ring_mt:__tostring()
+	return ("levee.Ring: n=%s size=%s"):format(self.n, self.size)
+end
+
+
+return function(size)
+	-- round size up to a power of 2
+	local n = 16
+	while n < (size or 0) do n = n * 2 end
+
+	local self = setmetatable({}, Ring_mt)
+	self.a, self.b, self.c, self.d =
+		new_tab(n, 0), new_tab(n, 0), new_tab(n, 0), new_tab(n, 0)
+	self.size = n
+	self.mask = n - 1
+	self.head = 1
+	self.tail = 1
+	self.n = 0
+	return self
+end
@@ -0,0 +1,104 @@
+local ffi = require("ffi")
+local C = ffi.C
+
+
+local REFS = {}
+
+
+local function castptr(cdata)
+	return tonumber(ffi.cast("uintptr_t", cdata))
+end
+
+
+local WheelItem_mt = {}
+WheelItem_mt.__index = WheelItem_mt
+
+
+function WheelItem_mt:__tostring()
+	return string.format("levee.WheelItem: expires=%s", self.expires)
+end
+
+
+function WheelItem_mt:remove()
+	REFS[castptr(self.wheel)][castptr(self)] = nil
+	C.levee_wheel_remove(self.wheel, self)
+end
+
+
+ffi.metatype("LeveeWheelItem", WheelItem_mt)
+
+
+local Wheel_mt = {}
+Wheel_mt.__index = Wheel_mt
+
+
+function Wheel_mt:__tostring()
+	return string.format("levee.Wheel: count=%d", #self)
+end
+
+
+function Wheel_mt:__len()
+	return C.levee_wheel_count(self)
+end
+
+
+function Wheel_mt:push(expires, val)
+	local item = C.levee_wheel_add(self, expires)
+	if item == nil then error("levee_wheel_add") end
+	REFS[castptr(self)][castptr(item)] = val
+	return item
+end
+
+
+-- returns the earliest time a timer could expire. this is a lower bound: a
+-- timer far enough out is only placed exactly once the wheel turns closer to it
+function Wheel_mt:peek()
+	local t = C.levee_wheel_next(self)
+	if t >= 0 then return t end
+end
+
+
+-- advances the wheel to now and pops the next timer that has expired
+function Wheel_mt:expire(now)
+	local item = C.levee_wheel_expire(self, now)
+	if item ~= nil then
+		local refs = REFS[castptr(self)]
+		local expires, val = item.expires, refs[castptr(item)]
+		refs[castptr(item)] = nil
+		C.levee_wheel_remove(self, item)
+		return expires, val
+	end
+end
+
+
+function Wheel_mt:clear()
+	REFS[castptr(self)] = {}
+	C.levee_wheel_clear(self)
+end
+
+
+function Wheel_mt:refs()
+	return REFS[castptr(self)]
+end
+
+
+function Wheel_mt:__gc()
+	REFS[castptr(self)] = nil
+	C.levee_wheel_destroy(self)
+end
+
+
+ffi.metatype("LeveeWheel", Wheel_mt)
+
+
+return {
+	REFS = REFS,
+
+	Wheel = function(now)
+		local self = C.levee_wheel_create(now or 0)
+		if self == nil then error("levee_wheel_create") end
+		ffi.gc(self, Wheel_mt.__gc)
+		REFS[castptr(self)] = {}
+		return self
+	end,
+}
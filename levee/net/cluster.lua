@@ -0,0 +1,222 @@
+local _ = require("levee._")
+local errors = require("levee.errors")
+
+
+local log = _.log.Log("levee.net.cluster")
+
+
+--
+-- Worker bootstrap
+
+-- runs in the worker's OS thread with the worker's own hub. this function is
+-- transferred with string.dump so it can't reference any upvalues.
+local function bootstrap(h, f, index, cpu, host, port, timeout, backlog)
+	local _ = require("levee._")
+
+	if cpu >= 0 then
+		-- pinning is best effort, a worker is still useful unpinned
+		_.set_affinity(cpu)
+	end
+
+	local err, serve = h.tcp:listen({
+		host = host,
+		port = port,
+		timeout = timeout or nil,
+		backlog = backlog or nil,
+		reuseport = true, })
+	if err then
+		h.parent:send({err = err.code})
+		return
+	end
+
+	h.parent:send({ready = serve:port()})
+
+	-- the parent closing its channel requests this worker to shutdown
+	h:spawn(function()
+		while true do
+			local err = h.parent:recv()
+			if err then break end
+		end
+		serve:close()
+	end)
+
+	local ok, got = pcall(loadstring(f), h, serve, index)
+	serve:close()
+	h.parent:send({exit = not ok and tostring(got) or false})
+end
+
+
+--
+-- Cluster
+
+-- A Cluster is N worker hubs, each running in its own OS thread with its own
+-- SO_REUSEPORT listener on the same address. The kernel balances incoming
+-- connections across the workers' listeners.
+
+local Cluster_mt = {}
+Cluster_mt.__index = Cluster_mt
+
+
+function Cluster_mt:__tostring()
+	return ("levee.Cluster: port=%s workers=%s"):format(
+		self._port, #self.workers)
+end
+
+
+function Cluster_mt:port()
+	return self._port
+end
+
+
+function Cluster_mt:_spawn(index)
+	local worker = self.workers[index]
+
+	local child = self.hub.thread:spawn(bootstrap,
+		self.f,
+		index,
+		worker.cpu,
+		self.options.host or "127.0.0.1",
+		self._port or self.options.port or 0,
+		self.options.timeout or false,
+		self.options.backlog or false)
+
+	local err, msg = child:recv()
+	if err then return err end
+	if msg.err then return errors.get(msg.err) end
+	if not msg.ready then return errors.CLOSED end
+
+	-- an ephemeral port is resolved by the first worker and then shared by the
+	-- rest
+	self._port = self._port or msg.ready
+	worker.child = child
+end
+
+
+function Cluster_mt:_respawn(index)
+	local worker = self.workers[index]
+	local options = self.options.cluster
+
+	while not self.closed do
+		if not options.respawn then return end
+
+		if options.max_restarts and worker.restarts >= options.max_restarts then
+			log:error("worker %s: giving up after %s restarts",
+				index, worker.restarts)
+			return
+		end
+
+		self.hub:sleep(options.backoff)
+		if self.closed then return end
+
+		worker.restarts = worker.restarts + 1
+		self.restarts = self.restarts + 1
+
+		local err = self:_spawn(index)
+		if not err then return true end
+		log:error("worker %s: failed to respawn: %s", index, err)
+	end
+end
+
+
+function Cluster_mt:_supervise(index)
+	local worker = self.workers[index]
+
+	while worker.child do
+		local err, msg = worker.child:recv()
+		if err or msg.exit ~= nil then
+			worker.child = nil
+			if self.closed then break end
+			if err then
+				log:error("worker %s lost", index)
+			elseif msg.exit then
+				log:error("worker %s crashed: %s", index, msg.exit)
+			else
+				-- a worker that returns is done, unless asked to keep it running
+				log:info("worker %s exited", index)
+				if not self.options.cluster.respawn_exited then break end
+			end
+			if not self:_respawn(index) then break end
+		end
+	end
+end
+
+
+function Cluster_mt:stats()
+	local alive = 0
+	for __, worker in ipairs(self.workers) do
+		if worker.child then alive = alive + 1 end
+	end
+	return {
+		workers = #self.workers,
+		alive = alive,
+		restarts = self.restarts, }
+end
+
+
+function Cluster_mt:close()
+	if self.closed then return end
+	self.closed = true
+	for __, worker in ipairs(self.workers) do
+		if worker.child then worker.child.sender:close() end
+	end
+	return true
+end
+
+
+local function Options(options)
+	local cluster = options.cluster
+	if type(cluster) ~= "table" then
+		cluster = {workers = cluster}
+	end
+	if type(cluster.workers) ~= "number" then
+		cluster.workers = _.cpu_count()
+	end
+	if cluster.respawn == nil then cluster.respawn = true end
+	cluster.backoff = cluster.backoff or 100
+	options.cluster = cluster
+	return options
+end
+
+
+local function cpu(pin, index)
+	if not pin then return -1 end
+	if type(pin) == "table" then return pin[((index - 1) % #pin) + 1] end
+	return (index - 1) % _.cpu_count()
+end
+
+
+return function(hub, options)
+	if type(options.worker) ~= "function" then return errors.system.EINVAL end
+	-- SO_REUSEPORT only balances inet listeners; tls is left to the worker
+	if options.unix or options.tls then return errors.system.EINVAL end
+
+	options = Options(options)
+
+	local self = setmetatable({}, Cluster_mt)
+	self.hub = hub
+	self.options = options
+	self.f = string.dump(options.worker)
+	self.restarts = 0
+
+	self.workers = {}
+	for i = 1, options.cluster.workers do
+		self.workers[i] = {
+			index = i,
+			cpu = cpu(options.cluster.pin, i),
+			restarts = 0, }
+	end
+
+	for i = 1, #self.workers do
+		local err = self:_spawn(i)
+		if err then
+			self:close()
+			return err
+		end
+	end
+
+	for i = 1, #self.workers do
+		hub:spawn(function() self:_supervise(i) end)
+	end
+
+	return nil, self
+end
@@ -1,6 +1,145 @@
+local ffi = require("ffi")
+local C = ffi.C
+
+local errors = require("levee.errors")
 local _ = require("levee._")
 
 
+local LINUX = ffi.os:lower() == "linux"
+
+
+--
+-- Batch
+
+-- a fixed set of datagram slots, each with a buffer of up to `size` bytes and
+-- an endpoint. a batch is allocated once and reused by recvmany and sendmany,
+-- so no allocations are made per datagram. slots are numbered from 1.
+
+-- room for one control message carrying an int, the GRO segment size
+local CMSG_HDR = LINUX and ffi.sizeof("struct cmsghdr") or 0
+local CMSG_SPACE = CMSG_HDR + 8
+
+local Batch_mt = {}
+Batch_mt.__index = Batch_mt
+
+
+function Batch_mt:__tostring()
+	return string.format(
+		"levee.net.Batch: count=%d n=%d size=%d", self.count, self.n, self.size)
+end
+
+
+-- returns a pointer to and the length of slot `i`'s datagram
+function Batch_mt:value(i)
+	local iov = self.iov[i - 1]
+	return iov.iov_base, tonumber(iov.iov_len)
+end
+
+
+function Batch_mt:string(i)
+	return ffi.string(self:value(i))
+end
+
+
+-- returns slot `i`'s endpoint. it's reused by the next call on the batch, so
+-- copy it if it needs to outlive that
+function Batch_mt:endpoint(i)
+	return self.eps[i - 1]
+end
+
+
+-- returns the segment size if the kernel coalesced several datagrams into
+-- slot `i`, which can only happen with gro enabled on the receiving socket
+function Batch_mt:segment(i)
+	if not LINUX then return end
+	local hdr = self.msgs[i - 1].msg_hdr
+	local p = ffi.cast("char *", hdr.msg_control)
+	local off = 0
+	while off + CMSG_HDR <= hdr.msg_controllen do
+		local cmsg = ffi.cast("struct cmsghdr *", p + off)
+		if cmsg.cmsg_len < CMSG_HDR then return end
+		if cmsg.cmsg_level == C.SOL_UDP and cmsg.cmsg_type == C.UDP_GRO then
+			return ffi.cast("int *", p + off + CMSG_HDR)[0]
+		end
+		-- control messages are aligned to size_t
+		off = off + bit.band(tonumber(cmsg.cmsg_len) + 7, -8)
+	end
+end
+
+
+-- queues a datagram of `len` bytes from `buf` to `endpoint` to be sent with
+-- sendmany. `buf` isn't copied; a string is held on to until it's sent
+function Batch_mt:push(endpoint, buf, len)
+	if self.count == self.n then return errors.system.ENOBUFS end
+	len = len or #buf
+	local i = self.count
+	self.refs[i + 1] = buf
+	if type(buf) == "string" then buf = ffi.cast("char *", buf) end
+	self.iov[i].iov_base = buf
+	self.iov[i].iov_len = len
+	ffi.copy(self.eps[i], endpoint, ffi.sizeof(self.eps[i]))
+	self.count = i + 1
+end
+
+
+function Batch_mt:clear()
+	for i = 1, self.count do self.refs[i] = nil end
+	self.count = 0
+end
+
+
+-- points each slot back at its own buffer, ready for a receive
+function Batch_mt:_reset(n)
+	for i = 0, n - 1 do
+		local iov = self.iov[i]
+		iov.iov_base = self.buf + i * self.size
+		iov.iov_len = self.size
+		if LINUX then
+			local hdr = self.msgs[i].msg_hdr
+			hdr.msg_namelen = ffi.sizeof(self.eps[i].addr)
+			hdr.msg_controllen = CMSG_SPACE
+			hdr.msg_flags = 0
+		else
+			self.eps[i].len[0] = ffi.sizeof(self.eps[i].addr)
+		end
+	end
+end
+
+
+-- records slot `i`'s datagram after a receive
+function Batch_mt:_received(i, len, namelen)
+	local ep = self.eps[i]
+	ep.len[0] = namelen
+	ep.family[0] = ep.addr.sa.sa_family
+	self.iov[i].iov_len = len
+end
+
+
+local function Batch(n, size)
+	local self = setmetatable({}, Batch_mt)
+	self.n = n or 64
+	self.size = size or 2048
+	self.count = 0
+	self.refs = {}
+	self.buf = ffi.new("char[?]", self.n * self.size)
+	self.iov = ffi.new("struct iovec[?]", self.n)
+	self.eps = ffi.new("struct LeveeEndpoint[?]", self.n)
+	if LINUX then
+		self.msgs = ffi.new("struct mmsghdr[?]", self.n)
+		self.ctl = ffi.new("char[?]", self.n * CMSG_SPACE)
+		for i = 0, self.n - 1 do
+			local hdr = self.msgs[i].msg_hdr
+			hdr.msg_name = self.eps[i].addr
+			hdr.msg_iov = self.iov + i
+			hdr.msg_iovlen = 1
+			hdr.msg_control = self.ctl + i * CMSG_SPACE
+		end
+	end
+	self:_reset(self.n)
+	return self
+end
+
+
 local Dgram_mt = {}
 Dgram_mt.__index = Dgram_mt
 
@@ -29,6 +168,125 @@ function Dgram_mt:recvfrom(buf, len)
 end
 
 
+if LINUX then
+	function Dgram_mt:_recvmany(batch, n)
+		batch:_reset(n)
+		local rc = C.recvmmsg(self.no, batch.msgs, n, 0, nil)
+		if rc < 0 then return errors.get(ffi.errno()) end
+		for i = 0, rc - 1 do
+			local msg = batch.msgs[i]
+			batch:_received(i, msg.msg_len, msg.msg_hdr.msg_namelen)
+		end
+		return nil, rc
+	end
+
+	function Dgram_mt:_sendmany(batch, off, n)
+		for i = off, n - 1 do
+			local hdr = batch.msgs[i].msg_hdr
+			hdr.msg_namelen = batch.eps[i].len[0]
+			hdr.msg_controllen = 0
+		end
+		local rc = C.sendmmsg(self.no, batch.msgs + off, n - off, 0)
+		if rc < 0 then return errors.get(ffi.errno()) end
+		return nil, rc
+	end
+else
+	-- without recvmmsg and sendmmsg, fall back to a call per datagram
+	function Dgram_mt:_recvmany(batch, n)
+		batch:_reset(n)
+		for i = 0, n - 1 do
+			local ep = batch.eps[i]
+			local rc = C.recvfrom(
+				self.no, batch.buf + i * batch.size, batch.size, 0, ep.addr.sa,
+				ep.len)
+			if rc < 0 then
+				if i > 0 then return nil, i end
+				return errors.get(ffi.errno())
+			end
+			batch:_received(i, rc, ep.len[0])
+		end
+		return nil, n
+	end
+
+	function Dgram_mt:_sendmany(batch, off, n)
+		for i = off, n - 1 do
+			local ep = batch.eps[i]
+			local iov = batch.iov[i]
+			local rc = C.sendto(
+				self.no, iov.iov_base, iov.iov_len, 0, ep.addr.sa, ep.len[0])
+			if rc < 0 then
+				if i > off then return nil, i - off end
+				return errors.get(ffi.errno())
+			end
+		end
+		return nil, n - off
+	end
+end
+
+
+-- receives up to `n` datagrams, by default as many as `batch` holds, in a
+-- single call. blocks until at least one is available. returns err, count;
+-- the datagrams are in slots 1 to count.
+function Dgram_mt:recvmany(batch, n)
+	if self.closed then return errors.CLOSED end
+	n = math.min(n or batch.n, batch.n)
+
+	batch:clear()
+	local err, count = self:_recvmany(batch, n)
+	if not err then
+		batch.count = count
+		return nil, count
+	end
+	if not err.is_system_EAGAIN then return err end
+
+	local err, sender, ev = self.r_ev:recv(self.timeout)
+	if err then return err end
+	if ev < 0 then
+		self:close()
+		return errors.CLOSED
+	end
+
+	return self:recvmany(batch, n)
+end
+
+
+-- sends the datagrams pushed to `batch`. returns err, count, the number of
+-- datagrams sent. once they've all gone the batch is cleared for reuse.
+function Dgram_mt:sendmany(batch)
+	if self.closed then return errors.CLOSED end
+
+	local sent = 0
+	while sent < batch.count do
+		local err, n = self:_sendmany(batch, sent, batch.count)
+		if err then return err, sent end
+		sent = sent + n
+	end
+
+	batch:clear()
+	return nil, sent
+end
+
+
+-- sets the UDP segment size for generic segmentation offload. a datagram
+-- sent larger than `size` is split by the kernel, or the NIC, into datagrams
+-- of `size` bytes each, to the same endpoint. 0 disables it.
+function Dgram_mt:gso(size)
+	if not LINUX then return errors.system.ENOPROTOOPT end
+	local err = _.setsockopt(self.no, C.SOL_UDP, C.UDP_SEGMENT, size)
+	if err then return err end
+end
+
+
+-- enables generic receive offload: the kernel may coalesce datagrams from the
+-- same endpoint into one slot, see Batch:segment.
+function Dgram_mt:gro(on)
+	if not LINUX then return errors.system.ENOPROTOOPT end
+	local err = _.setsockopt(
+		self.no, C.SOL_UDP, C.UDP_GRO, on == false and 0 or 1)
+	if err then return err end
+end
+
+
 function Dgram_mt:addr()
 	return _.getsockname(self.no)
 end
@@ -88,6 +346,12 @@ function UDP_mt:listen(port, host)
 end
 
 
+-- returns a Batch of `n` slots of `size` bytes for recvmany and sendmany
+function UDP_mt:batch(n, size)
+	return Batch(n, size)
+end
+
+
 return function(hub)
 	return setmetatable({hub = hub}, UDP_mt)
 end
@@ -9,56 +9,7 @@ local errors = levee.errors
 local log = _.log.Log("levee.net.dialer")
 
 
---
--- Dialer Request
-
-local Request_mt = {}
-Request_mt.__index = Request_mt
-
-
-function Request_mt:value()
-	return ffi.cast("char*", self), ffi.sizeof(self)
-end
-
-
-function Request_mt:writeinto_iovec(iov)
-	iov:writeraw(self:value())
-end
-
-
-function Request_mt:__len()
-	return ffi.sizeof(self)
-end
-
-
-local Request = ffi.metatype("struct LeveeDialerRequest", Request_mt)
-
-
-ffi.cdef([[
-struct LeveeDialerResponse {
-	int err;
-	struct addrinfo *info;
-};
-]])
-
-
---
--- Message
-
-local Message_mt = {}
-Message_mt.__index = Message_mt
-
-
-function Message_mt:writeinto_iovec(iov)
-	iov:write(self[1])
-	iov:write(self[2])
-	iov:write(self[3])
-end
-
-
-local function Message(req, node, service)
-	return setmetatable({ req, node, service }, Message_mt)
-end
+local Response = ffi.typeof("struct LeveeDialerResponse")
 
 
 --
@@ -227,19 +178,31 @@ function Dialer_mt:__dial(family, socktype, node, service, timeout)
 	node = node or "127.0.0.1"
 	service = service and tostring(service) or "0"
 
-	self.req.family = family
-	self.req.socktype = socktype
-	self.req.node_len = #node
-	self.req.service_len = #service
-
-	self.sender:send(Message(self.req, node, service))
+	local res
+	if C.levee_dialer_lookup(node, service, family, socktype, self.res) == 1 then
+		res = self.res
+	else
+		self.id = self.id + 1
+		local id = self.id
+		local rc = C.levee_dialer_submit(node, service, family, socktype, self.w, id)
+		if rc < 0 then return errors.get(rc) end
+
+		local sender, recver = self.hub:pipe()
+		self.waiting[id] = sender
+		local err
+		err, res = recver:recv()
+		if err then return err end
+	end
 
-	self.recver:read(self.res)
-	local res = self.res[0]
-	if res.err ~= 0 then return errors.get(res.err) end
+	local entry = res.entry
+	if res.err ~= 0 then
+		local err = errors.get(res.err)
+		C.levee_dialer_release(entry)
+		return err
+	end
 
 	local err, conn = connect_all(self.hub, res.info, timeout)
-	C.freeaddrinfo(res.info)
+	C.levee_dialer_release(entry)
 	return err, conn
 end
 
@@ -249,26 +212,36 @@ function Dialer_mt:init()
 		self.state = C.levee_dialer_init()
 		if self.state.rc ~= 0 then return errors.get(self.state.rc) end
 
-		self.r, self.w = _.pipe()
-
-		self.req = Request()
-		self.req.no = self.w
+		local options = self.options
+		if options.threads or options.ttl or options.negative_ttl then
+			local rc = C.levee_dialer_configure(
+				options.threads or 0,
+				options.ttl or C.LEVEE_DIALER_TTL,
+				options.negative_ttl or C.LEVEE_DIALER_NEGATIVE_TTL)
+			if rc ~= 0 then return errors.get(rc) end
+		end
 
-		self.res = ffi.new("struct LeveeDialerResponse[1]")
+		self.r, self.w = _.pipe()
+		self.res = Response()
+		self.id = 0
+		self.waiting = {}
 
-		-- Note we leave sender as blocking
-		self.sender = self.hub.io:w(self.state.io[1])
 		_.fcntl_nonblock(self.r)
 		self.recver = self.hub.io:r(self.r)
 
-		-- setup a loop to process requests in series
-		self.q_sender, self.q_recver = self.hub:queue()
+		-- route responses from the resolver threads back to their dials
 		self.hub:spawn(function()
-			for req in self.q_recver do
-				local sender, family, socktype, node, service, timeout = unpack(req)
-				if timeout == -1 then timeout = nil end
-				sender:pass(self:__dial(family, socktype, node, service, timeout))
-				sender:close()
+			local buf, len = ffi.new(Response), ffi.sizeof(Response)
+			while true do
+				local err = self.recver:readn(ffi.cast("char*", buf), len)
+				if err then break end
+				local sender = self.waiting[buf.id]
+				self.waiting[buf.id] = nil
+				if sender then
+					sender:send(Response(buf))
+				else
+					C.levee_dialer_release(buf.entry)
+				end
 			end
 		end)
 	end
@@ -285,13 +258,41 @@ function Dialer_mt:dial(family, socktype, node, service, timeout, async)
 	end
 
 	log:info("SYNC: %s", node)
-	self:init()
-	local sender, recver = self.hub:pipe()
-	self.q_sender:send({sender, family, socktype, node, service, timeout or -1})
-	return recver:recv()
+	local err = self:init()
+	if err then return err end
+	return self:__dial(family, socktype, node, service, timeout)
+end
+
+
+-- returns the process wide counters for the getaddrinfo resolver threads and
+-- their cache
+function Dialer_mt:stats()
+	local stats = ffi.new("LeveeDialerStats")
+	C.levee_dialer_stats(stats)
+	local hits, misses = tonumber(stats.hits), tonumber(stats.misses)
+	local resolved = tonumber(stats.resolved)
+	return {
+		hits = hits,
+		negative = tonumber(stats.negative),
+		misses = misses,
+		hit_rate = hits + misses > 0 and hits / (hits + misses) or 0,
+		resolved = resolved,
+		failed = tonumber(stats.failed),
+		latency_mean = resolved > 0 and tonumber(stats.latency) / resolved or 0,
+		latency_max = tonumber(stats.latency_max),
+		pending = tonumber(stats.pending),
+		threads = tonumber(stats.threads),
+		cached = tonumber(stats.cached), }
+end
+
+
+-- drops every cached lookup
+function Dialer_mt:flush()
+	C.levee_dialer_flush()
 end
 
 
-return function(hub)
-	return setmetatable({hub = hub, defaults={}, }, Dialer_mt)
+return function(hub, options)
+	return setmetatable(
+		{hub = hub, options = options or {}, defaults = {}, }, Dialer_mt)
 end
@@ -5,6 +5,7 @@ local levee = require("levee")
 local _ = levee._
 
 local errors = require("levee.errors")
+local rand = require("levee._.rand")
 
 
 
@@ -30,13 +31,19 @@ local function parse_name(rr, packet)
 end
 
 
+-- returns err, records and, for negative answers, the ttl to cache them for:
+-- the lesser of the SOA's ttl and minimum in the authority section, see RFC
+-- 2308. that's nil when there's no SOA
 local function parse(packet, qtype)
 	local rcerror = _.dns_rcerror(packet.header.rcode)
-	if rcerror ~= errors.dns.NOERROR then return rcerror end
+	if rcerror ~= errors.dns.NOERROR and rcerror ~= errors.dns.NXDOMAIN then
+		return rcerror
+	end
 
 	local rr = ffi.new("struct dns_rr")
 	local rri = ffi.new("struct dns_rr_i [1]")
 	local recs = {}
+	local negttl
 
 	local rri = C.dns_rr_i_init(rri, packet);
 
@@ -44,7 +51,7 @@ local function parse(packet, qtype)
 		local err, count = _.dns_rr_grep(rr, rri, packet)
 		if err then return err end
 
-		if count == 0 then return nil, recs end
+		if count == 0 then break end
 
 		local s = _.dns_section(rr)
 		local t = _.dns_type(rr)
@@ -58,13 +65,21 @@ local function parse(packet, qtype)
 
 			r = {name=n, type=t, record=r, ttl=rr.ttl}
 			table.insert(recs, r)
+
+		elseif s == "AUTHORITY" and t == "SOA" then
+			local err, r = parse_record(rr, packet)
+			if err then return err end
+			local minimum = tonumber(r:match("(%d+)$"))
+			negttl = math.min(rr.ttl, minimum or rr.ttl)
 		end
 	end
 
-	return nil, recs
+	if rcerror ~= errors.dns.NOERROR then return rcerror, nil, negttl end
+	return nil, recs, negttl
 end
 
 
+-- copies the nameserver addresses out of `hints`, so they outlive it
 local function nameservers(hints)
 	local addrs = {}
 	local head = hints.head
@@ -73,7 +88,9 @@ local function nameservers(hints)
 		for i=0,head.count do
 			local ss = ffi.cast("struct sockaddr_in*", head.addrs[i].ss)
 			if ss.sin_addr.s_addr ~= 0 then
-				table.insert(addrs, ss)
+				local addr = ffi.new("struct sockaddr_in")
+				ffi.copy(addr, ss, ffi.sizeof(addr))
+				table.insert(addrs, addr)
 			end
 		end
 		head = head.next
@@ -83,52 +100,30 @@ local function nameservers(hints)
 end
 
 
---
--- Resolver
-
--- A Resolver sends a question to DNS server(s) and returns a table of records
-
-local Resolver_mt = {}
-Resolver_mt.__index = Resolver_mt
-
-
-function Resolver_mt:poll(so, packet, nameserver)
-	if self.closed then return errors.CLOSED end
-
-	local err, data
-	while not data do
-		err, data = _.dns_so_query(so, packet, nameserver)
-		if err then
-			if not err.is_system_EAGAIN then return err end
-			err = self.r_ev:recv(self.options.timeout)
-			if err then return err end
-		end
-	end
-
-	return nil, data
-end
-
-
-function Resolver_mt:load()
+local function load(options)
 	local err, resconf
-	if self.options.resconf then
-		err, resconf = _.dns_resconf_loadpath(self.options.resconf)
+	if options.resconf then
+		err, resconf = _.dns_resconf_loadpath(options.resconf)
 		if err then return err end
 	else
 		err, resconf = _.dns_resconf_local()
 		if err then return err end
 	end
+	resconf = ffi.gc(resconf, C.dns_resconf_close)
 
 	local err, hints = _.dns_hints_local(resconf)
 	if err then return err end
-
 	local ns = nameservers(hints)
-	if self.options.port or self.options.host then
+	-- hints from dns_hints_local are mortal, with no references left to drop
+	C.dns_hints_acquire(hints)
+	C.dns_hints_close(hints)
+
+	if options.port or options.host then
 		local sin_port, sin_addr
-		if self.options.port then sin_port = C.htons(self.options.port) end
-		if self.options.host then
+		if options.port then sin_port = C.htons(options.port) end
+		if options.host then
 			sin_addr = ffi.new("struct in_addr")
-			C.inet_aton(self.options.host, sin_addr)
+			C.inet_aton(options.host, sin_addr)
 		end
 		for __,addr in ipairs(ns) do
 			if sin_addr then addr.sin_addr = sin_addr end
@@ -136,89 +131,434 @@ function Resolver_mt:load()
 		end
 	end
 
-	local conf = {resconf=resconf, hosts=hosts, hints=hints, nameservers=ns}
+	local conf = {resconf=resconf, nameservers=ns}
 	return nil, conf
 end
 
 
-function Resolver_mt:query(qname, qtype)
-	if self.closed then return errors.CLOSED end
+-- returns a token that changes when the file at `path` does
+local function stamp(path)
+	local err, info = _.stat(path)
+	if err then return "" end
+	return ("%d.%09d:%d"):format(
+		tonumber(info.st_mtime.tv_sec),
+		tonumber(info.st_mtime.tv_nsec),
+		tonumber(info.st_size))
+end
 
-	if not qtype then qtype = "A" end
 
-	-- Don't resolve IP addresses
-	-- Some DNS servers return NXDOMAIN in this case, others return no
-	-- error. Let's make it consistent.
-	if not _.inet_pton(C.AF_INET, qname) then
-		return self:error(errors.dns.NXDOMAIN)
+--
+-- Cache
+
+-- answers by key, evicting the least recently used once `size` are held
+
+local Cache_mt = {}
+Cache_mt.__index = Cache_mt
+
+
+function Cache_mt:_unlink(node)
+	node.prev.next = node.next
+	node.next.prev = node.prev
+end
+
+
+function Cache_mt:_push(node)
+	node.prev = self.head
+	node.next = self.head.next
+	self.head.next.prev = node
+	self.head.next = node
+end
+
+
+function Cache_mt:get(key)
+	local node = self.nodes[key]
+	if not node then return end
+	self:_unlink(node)
+	self:_push(node)
+	return node.value
+end
+
+
+function Cache_mt:put(key, value)
+	if self.size <= 0 then return end
+
+	local node = self.nodes[key]
+	if node then
+		node.value = value
+		self:_unlink(node)
+		self:_push(node)
+		return
 	end
-	if not _.inet_pton(C.AF_INET6, qname) then
-		return self:error(errors.dns.NXDOMAIN)
+
+	if self.n >= self.size then
+		local oldest = self.head.prev
+		self:remove(oldest.key)
+		self.evicted = self.evicted + 1
 	end
 
-	local err, conf = self:load()
-	if err then return self:error(err) end
+	node = {key=key, value=value}
+	self.nodes[key] = node
+	self:_push(node)
+	self.n = self.n + 1
+end
 
-	local err, question = _.dns_p_make()
-	if err then return self:error(err) end
-	-- use recursion if the DNS server allows it
-	question.header.rd = 1
 
-	err = _.dns_p_push(question, qname, qtype)
-	if err then return self:error(err) end
+function Cache_mt:remove(key)
+	local node = self.nodes[key]
+	if not node then return end
+	self:_unlink(node)
+	self.nodes[key] = nil
+	self.n = self.n - 1
+end
 
-	for __, addr in ipairs(conf.nameservers) do
-		err, so = _.dns_so_open(self.no, conf.resconf.iface)
-		if err then return self:error(err) end
-
-		err, packet = self:poll(so, question, addr)
-		if err and err ~= errors.TIMEOUT then return self:error(err) end
-		if packet then
-			self:close()
-			return parse(packet, qtype)
+
+function Cache_mt:clear()
+	self.nodes = {}
+	self.head.next = self.head
+	self.head.prev = self.head
+	self.n = 0
+end
+
+
+local function Cache(size)
+	local self = setmetatable({size=size, evicted=0}, Cache_mt)
+	self.head = {}
+	self:clear()
+	return self
+end
+
+
+--
+-- DNS
+
+-- Queries for a hub are sent from a single UDP socket, and each is told apart
+-- by its query id. The socket is replaced once it has sent ROTATE queries and
+-- none are in flight, so the source port doesn't stay fixed for long.
+--
+-- resolv.conf is parsed once and cached, keyed by the resolve options that
+-- shape it. It's stat'ed at most every RECHECK ms and reloaded if its mtime or
+-- size has changed.
+--
+-- Answers are cached per (qname, qtype) for the least of their records' ttls,
+-- and NXDOMAIN or empty answers for their SOA's negative ttl. Resolves for a
+-- name already in flight wait on that query rather than sending their own.
+
+local RESCONF = "/etc/resolv.conf"
+local RECHECK = 1000
+local ROTATE = 4096
+local MAXUDP = 65536
+
+
+local DNS_mt = {}
+DNS_mt.__index = DNS_mt
+
+
+function DNS_mt:conf(options)
+	local path = options.resconf or RESCONF
+	local key = ("%s:%s:%s"):format(path, options.host or "", options.port or "")
+	local now = self.hub:now()
+
+	local conf = self.confs[key]
+	if conf and now < conf.checked then return nil, conf end
+
+	local token = stamp(path)
+	if conf and conf.token == token then
+		conf.checked = now + self.recheck
+		return nil, conf
+	end
+
+	local err, conf = load(options)
+	if err then return err end
+	self.loads = self.loads + 1
+	conf.key = key
+	conf.token = token
+	conf.checked = now + self.recheck
+	self.confs[key] = conf
+	return nil, conf
+end
+
+
+function DNS_mt:_open()
+	local err, no = _.socket(C.AF_INET, C.SOCK_DGRAM)
+	if err then return err end
+	_.fcntl_nonblock(no)
+	self.no = no
+	self.r_ev = self.hub:register(no, true)
+	self.sent = 0
+
+	local r_ev = self.r_ev
+	self.hub:spawn(function()
+		local buf = ffi.new("char[?]", MAXUDP)
+		local from = ffi.new("struct sockaddr_in")
+		local fromlen = ffi.new("socklen_t[1]")
+
+		while true do
+			local err, sender, ev = r_ev:recv()
+			if err or ev < 0 then return end
+
+			while true do
+				fromlen[0] = ffi.sizeof(from)
+				local n = C.recvfrom(no, buf, MAXUDP, 0,
+					ffi.cast("struct sockaddr *", from), fromlen)
+				if n < 0 then break end
+				self:_received(buf, tonumber(n), from)
+			end
 		end
+	end)
+end
+
+
+function DNS_mt:_close()
+	if not self.no then return end
+	self.hub:unregister(self.no)
+	self.no = nil
+	self.r_ev = nil
+end
+
+
+-- returns the name, type and class of the packet's question, or nil if it
+-- doesn't have exactly one
+local function question_of(packet)
+	if C.dns_p_count(packet, C.DNS_S_QD) ~= 1 then return end
+	local rr = ffi.new("struct dns_rr")
+	if C.dns_rr_parse(rr, 12, packet) ~= 0 then return end
+	local err, any = _.dns_d_expand(rr, packet)
+	if err then return end
+	return ffi.string(any.ns.host):lower(), tonumber(rr.type), tonumber(rr.class)
+end
+
+
+-- hands a response to the query waiting on its id, if it came from the
+-- nameserver the query was sent to and answers the question asked
+function DNS_mt:_received(buf, n, from)
+	if n < ffi.sizeof("struct dns_header") then return end
+	local header = ffi.cast("struct dns_header *", buf)
+	local query = self.pending[header.qid]
+	if not query or header.qr ~= 1 or
+			from.sin_addr.s_addr ~= query.addr.sin_addr.s_addr or
+			from.sin_port ~= query.addr.sin_port then
+		self.stale = self.stale + 1
+		return
+	end
+
+	local err, packet = _.dns_p_make(n)
+	if err then return end
+	packet = ffi.gc(packet, C.free)
+	ffi.copy(packet.data, buf, n)
+	packet["end"] = n
+	if C.dns_p_study(packet) ~= 0 then return end
+
+	-- as dns_so_verify does, the answer must be to the question asked, which
+	-- a spoofed response would have to guess along with the qid and port
+	local name, qtype, qclass = question_of(packet)
+	if name ~= query.name or qtype ~= query.type or qclass ~= query.class then
+		self.stale = self.stale + 1
+		return
 	end
 
-	return self:error(err)
+	self.pending[header.qid] = nil
+	query.sender:send(packet)
 end
 
 
-function Resolver_mt:close()
-	if self.closed then return errors.CLOSED end
+-- sends `question` to the nameserver `addr` and waits for its answer
+function DNS_mt:exchange(question, addr, timeout)
+	if self.no and self.sent >= ROTATE and not next(self.pending) then
+		self:_close()
+	end
+	if not self.no then
+		local err = self:_open()
+		if err then return err end
+	end
 
-	self.closed = true
-	self.hub:unregister(self.no, true)
-	self.hub:continue()
-	return
+	local qid
+	repeat
+		qid = rand.integer(65536) or math.random(0, 65535)
+	until not self.pending[qid]
+	question.header.qid = qid
+
+	local n = C.sendto(self.no, question.data, question["end"], 0,
+		ffi.cast("struct sockaddr *", addr), ffi.sizeof(addr))
+	if n < 0 then return errors.get(ffi.errno()) end
+	self.sent = self.sent + 1
+	self.queries = self.queries + 1
+
+	local sender, recver = self.hub:flag()
+	local name, qtype, qclass = question_of(question)
+	self.pending[qid] = {
+		sender=sender, addr=addr, name=name, type=qtype, class=qclass}
+	local err, packet = recver:recv(timeout)
+	if err then
+		self.pending[qid] = nil
+		if err == errors.TIMEOUT then self.timeouts = self.timeouts + 1 end
+		return err
+	end
+	return nil, packet
 end
 
 
-function Resolver_mt:error(err)
-	if not self.closed then self:close() end
+-- sends the question for `qname` to each of `conf`'s nameservers in turn,
+-- until one answers. returns err, records, negttl as parse does
+function DNS_mt:query(qname, qtype, options, conf)
+	local err, question = _.dns_p_make()
+	if err then return err end
+	question = ffi.gc(question, C.free)
+	-- use recursion if the DNS server allows it
+	question.header.rd = 1
+
+	err = _.dns_p_push(question, qname, qtype)
+	if err then return err end
+
+	for __, addr in ipairs(conf.nameservers) do
+		local packet
+		err, packet = self:exchange(question, addr, options.timeout)
+		if err and err ~= errors.TIMEOUT then return err end
+		if packet then return parse(packet, qtype) end
+	end
+
 	return err
 end
 
 
-local DNS_mt = {}
-DNS_mt.__index = DNS_mt
+-- runs the query for `key`, caching its answer and handing it to any
+-- resolves that arrived while it was in flight
+function DNS_mt:_fetch(key, qname, qtype, options, conf)
+	local waiters = {}
+	self.inflight[key] = waiters
+
+	local err, records, negttl = self:query(qname, qtype, options, conf)
+	self.inflight[key] = nil
+
+	if not err or err == errors.dns.NXDOMAIN then
+		local ttl
+		if not err and #records > 0 then
+			ttl = records[1].ttl
+			for i = 2, #records do ttl = math.min(ttl, records[i].ttl) end
+		else
+			-- NXDOMAIN, or no records of this type
+			ttl = negttl and math.min(negttl, self.negative_ttl)
+		end
+		if ttl and ttl > 0 then
+			ttl = math.min(ttl, self.max_ttl) * 1000
+			self.cache:put(key, {
+				err = err,
+				records = records,
+				ttl = ttl,
+				expires = self.hub:now() + ttl, })
+		end
+	end
+
+	local answer = {err=err, records=records}
+	for __, sender in ipairs(waiters) do sender:send(answer) end
+	return err, records
+end
 
 
 function DNS_mt:resolve(qname, qtype, options)
 	if not options then options = {} end
 	if not options.timeout then options.timeout = 500 end
+	if not qtype then qtype = "A" end
 
-	local err, no = _.socket(C.AF_INET, C.SOCK_DGRAM)
+	-- Don't resolve IP addresses
+	-- Some DNS servers return NXDOMAIN in this case, others return no
+	-- error. Let's make it consistent.
+	if not _.inet_pton(C.AF_INET, qname) then
+		return errors.dns.NXDOMAIN
+	end
+	if not _.inet_pton(C.AF_INET6, qname) then
+		return errors.dns.NXDOMAIN
+	end
+
+	local err, conf = self:conf(options)
 	if err then return err end
-	_.fcntl_nonblock(no)
-	local r_ev = self.hub:register(no, true)
-	local r = setmetatable(
-		{hub=self.hub, no=no, r_ev=r_ev, options=options},
-		Resolver_mt)
 
-	return r:query(qname, qtype)
+	local key = ("%s %s %s"):format(conf.key, qtype, qname:lower())
+
+	local entry = self.cache:get(key)
+	if entry then
+		local remain = entry.expires - self.hub:now()
+		if remain > 0 then
+			self.hits = self.hits + 1
+			if entry.err or #entry.records == 0 then
+				self.negative = self.negative + 1
+			end
+			-- refresh popular entries before they expire, so they never miss
+			if self.prefetch and remain < entry.ttl * self.prefetch and
+					not self.inflight[key] then
+				self.prefetches = self.prefetches + 1
+				self.hub:spawn(function()
+					self:_fetch(key, qname, qtype, options, conf)
+				end)
+			end
+			return entry.err, entry.records
+		end
+		self.cache:remove(key)
+		self.expired = self.expired + 1
+	end
+
+	local waiters = self.inflight[key]
+	if waiters then
+		self.coalesced = self.coalesced + 1
+		local sender, recver = self.hub:flag()
+		table.insert(waiters, sender)
+		local err, answer = recver:recv()
+		if err then return err end
+		return answer.err, answer.records
+	end
+
+	self.misses = self.misses + 1
+	return self:_fetch(key, qname, qtype, options, conf)
+end
+
+
+function DNS_mt:stats()
+	local pending = 0
+	for __ in pairs(self.pending) do pending = pending + 1 end
+	return {
+		queries = self.queries,
+		pending = pending,
+		timeouts = self.timeouts,
+		stale = self.stale,
+		loads = self.loads,
+		hits = self.hits,
+		negative = self.negative,
+		misses = self.misses,
+		hit_rate = self.hits + self.misses > 0 and
+			self.hits / (self.hits + self.misses) or 0,
+		coalesced = self.coalesced,
+		prefetches = self.prefetches,
+		expired = self.expired,
+		evicted = self.cache.evicted,
+		cached = self.cache.n, }
+end
+
+
+-- drops every cached answer
+function DNS_mt:flush()
+	self.cache:clear()
 end
 
 
-return function(hub)
-	return setmetatable({hub = hub}, DNS_mt)
+return function(hub, options)
+	options = options or {}
+	return setmetatable({
+		hub = hub,
+		recheck = RECHECK,
+		confs = {},
+		pending = {},
+		inflight = {},
+		cache = Cache(options.size or 1024),
+		max_ttl = options.max_ttl or 86400,
+		negative_ttl = options.negative_ttl or 300,
+		prefetch = options.prefetch,
+		queries = 0,
+		timeouts = 0,
+		stale = 0,
+		loads = 0,
+		hits = 0,
+		negative = 0,
+		misses = 0,
+		coalesced = 0,
+		prefetches = 0,
+		expired = 0, }, DNS_mt)
 end
@@ -17,6 +17,32 @@ function Listener_mt:__call()
 end
 
 
+function Listener_mt:_accept(no)
+	local conn = self.hub.io:rw(no, self.timeout)
+
+	if self.tls then
+		local err
+		err, conn = self.tls:upgrade(conn)
+		if not err then err = conn:handshake() end
+		if err then
+			conn:close()
+			self.refused = self.refused + 1
+			return
+		end
+	end
+
+	if self.max_pending and #self.recver >= self.max_pending then
+		-- the consumer is backed up. this send blocks, pausing accepts until the
+		-- consumer makes room in the queue
+		self.deferred = self.deferred + 1
+	end
+
+	self.accepted = self.accepted + 1
+	local err = self.sender:send(conn)
+	if err then conn:close() end
+end
+
+
 function Listener_mt:loop()
 	while true do
 		local err, sender, ev = self.r_ev:recv()
@@ -25,29 +51,42 @@ function Listener_mt:loop()
 			return
 		end
 
+		-- drain the accept backlog, yielding back to the hub every accept_budget
+		-- connections so connection storms can't starve established connections
+		local n = 0
 		while true do
-			local err, no = _.accept(self.no)
+			local err, no = _.accept_nonblock(self.no)
 			-- TODO: only break on EAGAIN, should close on other errors
 			if err then break end
 
-			_.fcntl_nonblock(no)
-			local conn = self.hub.io:rw(no, self.timeout)
-
-			local err
-			if self.tls then
-				-- what to do on error??
-				err, conn = self.tls:upgrade(conn)
-				assert(not err)
-				err = conn:handshake()
-				assert(not err)
+			if self.refuse and #self.recver >= self.max_pending then
+				-- shed load instead of pausing
+				_.close(no)
+				self.refused = self.refused + 1
+			else
+				self:_accept(no)
 			end
 
-			self.sender:send(conn)
+			n = n + 1
+			if n == self.accept_budget then
+				n = 0
+				self.deferred = self.deferred + 1
+				self.hub:continue()
+			end
 		end
 	end
 end
 
 
+function Listener_mt:stats()
+	return {
+		accepted = self.accepted,
+		deferred = self.deferred,
+		refused = self.refused,
+		pending = #self.recver, }
+end
+
+
 function Listener_mt:addr()
 	return _.getsockname(self.no)
 end
@@ -186,6 +225,11 @@ TCP_mt.connect = TCP_mt.dial
 function TCP_mt:listen(port, host, timeout)
 	local options = Options(port, host, timeout)
 
+	if options.cluster then
+		local Cluster = require("levee.net.cluster")
+		return Cluster(self.hub, options)
+	end
+
 	local domain
 	local endpoint
 
@@ -213,14 +257,25 @@ function TCP_mt:listen(port, host, timeout)
 	local err, no = _.socket(domain, C.SOCK_STREAM)
 	if err then return err end
 
-	local err = _.listen(no, endpoint)
+	if options.reuseport then
+		local err = _.setsockopt(no, C.SOL_SOCKET, C.SO_REUSEPORT)
+		if err then _.close(no); return err end
+	end
+
+	local err = _.listen(no, endpoint, options.backlog)
 	if err then return err end
 
 	_.fcntl_nonblock(no)
 	self.no = no
 	self.timeout = options.timeout
+	self.accept_budget = options.accept_budget or 64
+	self.max_pending = options.max_pending
+	self.refuse = self.max_pending and options.refuse
+	self.accepted = 0
+	self.deferred = 0
+	self.refused = 0
 	self.r_ev = self.hub:register(no, true)
-	self.sender, self.recver = self.hub:pipe()
+	self.sender, self.recver = self.hub:queue(self.max_pending)
 
 	self.hub:spawn(self.loop, self)
 	return nil, self
@@ -174,6 +174,12 @@ local RW_mt = {}
 
 for k, v in pairs(IO.RW_mt) do RW_mt[k] = v end
 
+
+-- buffered writes flush straight to the fd, which would skip the encryption
+function RW_mt:buffered()
+	return errors.system.ENOTSUP
+end
+
 function RW_mt.__index(self, key)
 	if key == "p" then
 		self.p = setmetatable({
@@ -8,6 +8,7 @@ local meta = require("levee.meta")
 local Map = require("levee.d.map")
 local Parser = require("levee.p.http.parse")
 local Status = require("levee.p.http.status")
+local Prelude = require("levee.p.http.prelude")
 
 
 local VERSION = "HTTP/1.1"
@@ -102,27 +103,6 @@ parser.Response = function(config)
 end
 
 
---
--- Date response header cache
-
-local http_time = ffi.new("time_t [1]")
-local http_date = nil
-local http_date_buf = ffi.new("char [32]")
-local http_tm = ffi.new("struct tm")
-
-local function httpdate()
-	local t = C.time(nil)
-	if t ~= http_time[0] then
-		http_time[0] = t
-		C.gmtime_r(http_time, http_tm)
-		local len = C.strftime(
-			http_date_buf, 32, "%a, %d %b %Y %H:%M:%S GMT", http_tm)
-		http_date = ffi.string(http_date_buf, len)
-	end
-	return http_date
-end
-
-
 --- Returns HEX representation of num
 local hexstr = '0123456789abcdef'
 function num2hex(num)
@@ -545,7 +525,7 @@ function Server_mt:_response(request, response)
 	if err then return err end
 
 	if not headers["Date"] then
-		headers["Date"] = httpdate()
+		headers["Date"] = self.hub.http.prelude:date()
 	end
 
 	if no_content then
@@ -714,6 +694,244 @@ local function Options(port, host, options)
 	return o
 end
 
+--
+-- Client pool
+
+-- Keeps idle keep-alive Clients for reuse, keyed by upstream host, port and
+-- whether they use tls. A checkout takes the most recently used idle Client,
+-- dialing a new one if there's none. Once `max_active` Clients for an upstream
+-- are checked out, further checkouts wait in line for one to be checked in,
+-- up to `timeout` ms. Clients that have been closed, or whose peer has hung
+-- up while idle, are dropped rather than reused.
+
+local Pool_mt = {}
+Pool_mt.__index = Pool_mt
+
+
+local function Upstream()
+	return {idle = {}, active = 0, waiters = {}}
+end
+
+
+function Pool_mt:_upstream(key)
+	local upstream = self.upstreams[key]
+	if not upstream then
+		upstream = Upstream()
+		self.upstreams[key] = upstream
+	end
+	return upstream
+end
+
+
+-- pops idle Clients until one is fit to reuse
+function Pool_mt:_idle(upstream)
+	local now = self.hub:now()
+	while #upstream.idle > 0 do
+		local c = table.remove(upstream.idle)
+		self.n_idle = self.n_idle - 1
+		if not c.closed and now < c.pool_expires and not _.hungup(c.conn.no) then
+			return c
+		end
+		self.evicted = self.evicted + 1
+		c:close()
+	end
+end
+
+
+function Pool_mt:checkout(port, host, options)
+	options = Options(port, host or "127.0.0.1", options or {})
+	local key = ("%s:%s:%s"):format(
+		options.host or "127.0.0.1", options.port, options.tls and "tls" or "tcp")
+	local upstream = self:_upstream(key)
+
+	self.checkouts = self.checkouts + 1
+
+	local c = self:_idle(upstream)
+	if c then
+		self.reused = self.reused + 1
+		upstream.active = upstream.active + 1
+		return nil, c
+	end
+
+	if upstream.active >= self.max_active then
+		-- wait for a Client to be checked in, or for a slot to dial one
+		local start = self.hub:now()
+		local sender, recver = self.hub:flag()
+		local waiter = {sender=sender}
+		table.insert(upstream.waiters, waiter)
+		self.waits = self.waits + 1
+		local err, handoff = recver:recv(options.wait or self.timeout)
+		local waited = self.hub:now() - start
+		self.wait_time = self.wait_time + waited
+		if waited > self.wait_max then self.wait_max = waited end
+		if err then
+			waiter.gone = true
+			if err == errors.TIMEOUT then self.timeouts = self.timeouts + 1 end
+			-- a handoff can land after the timeout fired but before this ran;
+			-- pass it on rather than leak the slot
+			if waiter.handoff then
+				if waiter.handoff.c then
+					self:checkin(waiter.handoff.c)
+				else
+					self:_release(upstream)
+				end
+			end
+			return err
+		end
+		-- the Client's slot has been handed over, along with the Client itself
+		-- if it's reusable
+		if handoff.c then
+			self.reused = self.reused + 1
+			return nil, handoff.c
+		end
+	else
+		upstream.active = upstream.active + 1
+	end
+
+	self.dials = self.dials + 1
+	local err, c = self.http:connect(options)
+	if err then
+		self.dial_errors = self.dial_errors + 1
+		self:_release(upstream)
+		return err
+	end
+	c.pool_key = key
+	return nil, c
+end
+
+
+-- hands a checked out Client's slot to the first waiter, along with `c` if
+-- it's reusable. returns true if there was a waiter
+function Pool_mt:_handoff(upstream, c)
+	while #upstream.waiters > 0 do
+		local waiter = table.remove(upstream.waiters, 1)
+		if not waiter.gone then
+			waiter.handoff = {c=c}
+			waiter.sender:send(waiter.handoff)
+			return true
+		end
+	end
+end
+
+
+function Pool_mt:_release(upstream)
+	if not self:_handoff(upstream) then
+		upstream.active = upstream.active - 1
+	end
+end
+
+
+-- returns a Client to the pool once its responses have been read. Clients
+-- that have been closed, or that don't fit in the pool, are dropped
+function Pool_mt:checkin(c)
+	local upstream = self.upstreams[c.pool_key]
+	if not upstream then return c:close() end
+
+	if c.closed then
+		self.evicted = self.evicted + 1
+		return self:_release(upstream)
+	end
+
+	if self:_handoff(upstream, c) then return end
+	upstream.active = upstream.active - 1
+
+	if #upstream.idle >= self.max_idle then
+		return c:close()
+	end
+
+	c.pool_expires = self.hub:now() + self.idle_timeout
+	table.insert(upstream.idle, c)
+	self.n_idle = self.n_idle + 1
+
+	if not self.sweeping then
+		self.sweeping = true
+		self.hub:spawn_later(self.idle_timeout, function() self:_sweep() end)
+	end
+end
+
+
+-- closes Clients that have been idle for longer than idle_timeout
+function Pool_mt:_sweep()
+	local now = self.hub:now()
+	for __, upstream in pairs(self.upstreams) do
+		local idle = {}
+		for __, c in ipairs(upstream.idle) do
+			if now < c.pool_expires then
+				table.insert(idle, c)
+			else
+				self.evicted = self.evicted + 1
+				self.n_idle = self.n_idle - 1
+				c:close()
+			end
+		end
+		upstream.idle = idle
+	end
+
+	if self.n_idle > 0 then
+		self.hub:spawn_later(self.idle_timeout, function() self:_sweep() end)
+	else
+		self.sweeping = false
+	end
+end
+
+
+-- closes every idle Client
+function Pool_mt:clear()
+	for __, upstream in pairs(self.upstreams) do
+		for __, c in ipairs(upstream.idle) do c:close() end
+		upstream.idle = {}
+	end
+	self.n_idle = 0
+end
+
+
+function Pool_mt:stats()
+	local active = 0
+	for __, upstream in pairs(self.upstreams) do
+		active = active + upstream.active
+	end
+	local elapsed = (self.hub:now() - self.started) / 1000
+	return {
+		checkouts = self.checkouts,
+		reused = self.reused,
+		reuse_ratio = self.checkouts > 0 and self.reused / self.checkouts or 0,
+		dials = self.dials,
+		dial_errors = self.dial_errors,
+		dials_per_sec = elapsed > 0 and self.dials / elapsed or 0,
+		waits = self.waits,
+		wait_mean = self.waits > 0 and self.wait_time / self.waits or 0,
+		wait_max = self.wait_max,
+		timeouts = self.timeouts,
+		evicted = self.evicted,
+		active = active,
+		idle = self.n_idle, }
+end
+
+
+local function Pool(http, options)
+	options = options or {}
+	return setmetatable({
+		hub = http.hub,
+		http = http,
+		max_idle = options.max_idle or 8,
+		max_active = options.max_active or 64,
+		idle_timeout = options.idle_timeout or 60000,
+		timeout = options.timeout or 5000,
+		upstreams = {},
+		n_idle = 0,
+		started = http.hub:now(),
+		checkouts = 0,
+		reused = 0,
+		dials = 0,
+		dial_errors = 0,
+		waits = 0,
+		wait_time = 0,
+		wait_max = 0,
+		timeouts = 0,
+		evicted = 0, }, Pool_mt)
+end
+
+
 --
 -- HTTP module interface
 --
@@ -784,8 +1002,12 @@ M_mt.parser = parser
 M_mt.Map = Map
 
 
-function M_mt.__call(self, hub)
-	return setmetatable({hub = hub}, HTTP_mt)
+function M_mt.__call(self, hub, options)
+	options = options or {}
+	local http = setmetatable({hub = hub}, HTTP_mt)
+	http.prelude = Prelude.Prelude(hub)
+	http.pool = Pool(http, options.pool)
+	return http
 end
 
 
@@ -7,6 +7,7 @@ local Map = require("levee.d.map")
 local Uri = require("levee.p.uri")
 local Encoder = require("levee.p.utf8").Utf8
 local Status = require("levee.p.http.status")
+local Prelude = require("levee.p.http.prelude")
 local Parser = require("levee.p.http.parse")
 
 
@@ -16,6 +17,8 @@ local CRLF = "\r\n"
 
 local USER_AGENT = ("%s/%s"):format(meta.name, meta.version.string)
 
+local httpdate = Prelude.httpdate
+
 
 --
 -- Request
@@ -50,37 +53,188 @@ end
 
 
 --
--- Date response header cache
+-- Header views
+
+-- A lazily decoded header block. Rather than copying each name and value into
+-- a string, decoding records where each field sits in the block, which is
+-- copied out of the read buffer in one go; values are only made into strings
+-- when they're looked up. Fields common enough to be looked up for most
+-- messages are indexed as they're decoded, so finding them doesn't take a
+-- scan. Like a d.Map, lookups are case insensitive, and a field that appears
+-- more than once is returned as a list of its values.
+--
+-- Adding or setting a field turns the view into a d.Map, which it then stands
+-- in for. Until then, encoding a view writes its block as it was received.
+
+-- slots for the indexed fields, by name, as written and in lower case
+local COMMON = {
+	"Host", "Content-Length", "Connection", "Transfer-Encoding", }
+local COMMON_SLOT = {}
+local COMMON_BY_LEN = {}
+for slot, name in ipairs(COMMON) do
+	COMMON_SLOT[name] = slot
+	COMMON_SLOT[name:lower()] = slot
+	COMMON_BY_LEN[#name] = slot
+end
+
+
+local View_mt = {}
+
+
+local function view_value(self, i)
+	local spans = self._spans
+	local b = (i - 1) * 4
+	return ffi.string(self._ptr + spans[b + 3], spans[b + 4])
+end
 
-local http_time = ffi.new("time_t [1]")
-local http_date = nil
-local http_date_buf = ffi.new("char [32]")
-local http_tm = ffi.new("struct tm")
 
-local function httpdate()
-	local t = C.time(nil)
-	if t ~= http_time[0] then
-		http_time[0] = t
-		C.gmtime_r(http_time, http_tm)
-		local len = C.strftime(
-			http_date_buf, 32, "%a, %d %b %Y %H:%M:%S GMT", http_tm)
-		http_date = ffi.string(http_date_buf, len)
+local function view_scan(self, key)
+	local spans = self._spans
+	local len = #key
+	local first, list
+	for i = 1, self._n do
+		local b = (i - 1) * 4
+		if spans[b + 2] == len and
+				C.strncasecmp(self._ptr + spans[b + 1], key, len) == 0 then
+			if not first then
+				first = view_value(self, i)
+			else
+				if not list then list = {first} end
+				table.insert(list, view_value(self, i))
+			end
+		end
 	end
-	return http_date
+	return list or first
 end
 
 
---- Returns HEX representation of num
-local hexstr = '0123456789abcdef'
-local function num2hex(num)
-	local s = ''
-	while num > 0 do
-		local mod = math.fmod(num, 16)
-		s = string.sub(hexstr, mod+1, mod+1) .. s
-		num = math.floor(num / 16)
+-- returns the d.Map the view stands in for, decoding it the first time
+function View_mt:map()
+	local map = rawget(self, "_map")
+	if map then return map end
+	map = Map()
+	local spans = self._spans
+	for i = 1, self._n do
+		local b = (i - 1) * 4
+		map:add(
+			ffi.string(self._ptr + spans[b + 1], spans[b + 2]), view_value(self, i))
 	end
-	if s == '' then s = '0' end
-	return s
+	rawset(self, "_map", map)
+	return map
+end
+
+
+function View_mt:add(key, value)
+	self:map():add(key, value)
+end
+
+
+function View_mt:__index(key)
+	local method = View_mt[key]
+	if method then return method end
+
+	local map = rawget(self, "_map")
+	if map then return map[key] end
+
+	local slot = COMMON_SLOT[key]
+	if slot then
+		local i = self._common[slot]
+		if not i then return end
+		-- 0 marks a field that's repeated
+		if i > 0 then return view_value(self, i) end
+	end
+	return view_scan(self, key)
+end
+
+
+function View_mt:__newindex(key, value)
+	self:map()[key] = value
+end
+
+
+function View_mt:__tostring()
+	local map = rawget(self, "_map")
+	if map then return tostring(map) end
+	return self._block
+end
+
+
+local function View(block, spans, common, n)
+	return setmetatable({
+		_block = block,
+		-- a pointer to the block, which it keeps alive
+		_ptr = ffi.cast("const char *", block),
+		_spans = spans,
+		_common = common,
+		_n = n, }, View_mt)
+end
+
+
+--
+-- Header encoding
+
+-- Headers are copied straight into the buffer, so encoding them doesn't
+-- create any strings. Common field names are kept along with their separator,
+-- to be copied in one go.
+
+local FIELDS = {}
+for __, name in ipairs({
+		"Accept", "Cache-Control", "Connection", "Content-Encoding",
+		"Content-Length", "Content-Type", "Date", "ETag", "Host", "Last-Modified",
+		"Location", "Server", "Set-Cookie", "Transfer-Encoding",
+		"User-Agent", }) do
+	FIELDS[name] = name..FIELD_SEP
+end
+
+
+local digits = ffi.new("uint8_t [24]")
+
+-- pushes the unsigned integer `n`, in decimal or, for a `base` of 16, hex
+local function push_uint(buf, n, base)
+	base = base or 10
+	local i = 24
+	repeat
+		i = i - 1
+		local d = n % base
+		digits[i] = d < 10 and 48 + d or 87 + d
+		n = (n - d) / base
+	until n == 0
+	buf:write(digits + i, 24 - i)
+end
+
+
+local function push_field(buf, name, value)
+	local field = FIELDS[name]
+	if type(value) == "number" then
+		if field then
+			buf:write(field, #field)
+		else
+			buf:write(name, #name)
+			buf:write(FIELD_SEP, 2)
+		end
+		if value >= 0 and value % 1 == 0 then
+			push_uint(buf, value)
+		else
+			buf:push(tostring(value))
+		end
+		buf:write(CRLF, 2)
+		return
+	end
+
+	local n = (field and #field or #name + 2) + #value + 2
+	buf:ensure(n)
+	local p = buf:tail()
+	if field then
+		ffi.copy(p, field, #field)
+		p = p + #field
+	else
+		ffi.copy(p, name, #name)
+		ffi.copy(p + #name, FIELD_SEP, 2)
+		p = p + #name + 2
+	end
+	ffi.copy(p, value, #value)
+	ffi.copy(p + #value, CRLF, 2)
+	buf:bump(n)
 end
 
 
@@ -95,29 +249,51 @@ end
 
 
 local function encode_headers(buf, headers, nosep)
+	if getmetatable(headers) == View_mt then
+		local map = rawget(headers, "_map")
+		if not map then
+			buf:write(headers._block, #headers._block)
+			if not nosep then buf:write(CRLF, 2) end
+			return
+		end
+		headers = map
+	end
+
 	if type(headers) == "cdata" then
 		-- assume it's a d.Map
-		local last = nosep and "" or CRLF
-		buf:push(tostring(headers)..last)
+		local n = C.sp_http_map_encode_size(headers)
+		buf:ensure(n)
+		C.sp_http_map_encode(headers, buf:tail())
+		buf:bump(n)
+		if not nosep then buf:write(CRLF, 2) end
 		return
 	end
 
 	for k, v in pairs(headers) do
 		if type(v) == "table" then
 			for _,item in pairs(v) do
-				buf:push(k..FIELD_SEP..item..CRLF)
+				push_field(buf, k, item)
 			end
 		else
-			buf:push(k..FIELD_SEP..v..CRLF)
+			push_field(buf, k, v)
 		end
 	end
-	if not nosep then buf:push(CRLF) end
+	if not nosep then buf:write(CRLF, 2) end
+end
+
+
+local function set_length(headers, len)
+	-- a plain table takes the length as is, saving a string per message
+	if type(headers) == "cdata" or getmetatable(headers) == View_mt then
+		len = tostring(len)
+	end
+	headers["Content-Length"] = len
 end
 
 
 local function add_header(headers, key, value)
-	if type(headers) == "cdata" then
-		-- assume it's a d.Map
+	if type(headers) == "cdata" or getmetatable(headers) == View_mt then
+		-- assume it's a d.Map, or a View standing in for one
 		headers:add(key, value)
 		return
 	end
@@ -147,6 +323,54 @@ local function decode_headers(parser, stream)
 end
 
 
+-- decodes a header block into a View. returns `err`, `headers`, and the start
+-- of the body's value, as decode_headers does
+local function decode_view(parser, stream)
+	local spans, common = {}, {}
+	local n = 0
+	-- the block so far, which stays in the read buffer until it's complete
+	local off = 0
+
+	while true do
+		local buf, len = stream:value()
+		local err, rc = parser:next(buf + off, len - off)
+		if err then return err end
+
+		if rc == 0 then
+			local err = stream:readin()
+			if err then
+				if err == errors.CLOSED then return errors.http.ESYNTAX end
+				return err
+			end
+
+		elseif parser.type ~= C.SP_HTTP_FIELD then
+			local value = {parser:value(buf + off)}
+			local block = ffi.string(buf, off)
+			stream:trim(off + rc)
+			if parser:is_done() then parser:reset() end
+			return nil, View(block, spans, common, n), value
+
+		else
+			local field = parser.as.field
+			local b = n * 4
+			n = n + 1
+			spans[b + 1] = off + field.name_off
+			spans[b + 2] = field.name_len
+			spans[b + 3] = off + field.value_off
+			spans[b + 4] = field.value_len
+
+			local slot = COMMON_BY_LEN[field.name_len]
+			if slot and C.strncasecmp(
+					buf + spans[b + 1], COMMON[slot], field.name_len) == 0 then
+				common[slot] = common[slot] and 0 or n
+			end
+
+			off = off + rc
+		end
+	end
+end
+
+
 local function decode_len(value)
 	if not value[2] then
 		-- content-length response
@@ -189,7 +413,8 @@ local function encode_request(buf, method, path, params, headers, body)
 		return
 	end
 
-	add_header(headers, "Content-Length", tostring(#body))
+	-- set rather than added, so a forwarded request keeps a single length
+	set_length(headers, #body)
 	encode_headers(buf, headers)
 	buf:push(body)
 end
@@ -209,14 +434,14 @@ local function encode_response(buf, status, headers, body)
 	end
 
 	if type(body) == "string" then
-		headers["Content-Length"] = tostring(#body)
+		set_length(headers, #body)
 		encode_headers(buf, headers)
-		buf:push(body)
+		buf:write(body, #body)
 		return
 	end
 
 	if body then
-		headers["Content-Length"] = tostring(tonumber(body))
+		set_length(headers, tonumber(body))
 	end
 
 	if headers["Content-Length"] then
@@ -231,22 +456,28 @@ local function encode_response(buf, status, headers, body)
 end
 
 
+local LAST_CHUNK = CRLF.."0"..CRLF..CRLF
+
+
 local function encode_chunk(buf, chunk)
-	buf:push(CRLF)
-	if not chunk then buf:push("0"..CRLF..CRLF) return end
+	if not chunk then buf:write(LAST_CHUNK, #LAST_CHUNK) return end
+	buf:write(CRLF, 2)
 
 	if type(chunk) ~= "string" then
 		-- always end with CRLF when it's a number since the only option is for
 		-- the user to push data to the buffer
-		buf:push(num2hex(tonumber(chunk))..CRLF)
+		push_uint(buf, tonumber(chunk), 16)
+		buf:write(CRLF, 2)
 		return
 	end
 
-	buf:push(num2hex(#chunk)..CRLF..chunk)
+	push_uint(buf, #chunk, 16)
+	buf:write(CRLF, 2)
+	buf:write(chunk, #chunk)
 end
 
 
-local function decode_request(parser, stream)
+local function decode_request(parser, stream, lazy)
 	parser:init_request()
 
 	local err, value = parser:stream_next(stream)
@@ -256,7 +487,13 @@ local function decode_request(parser, stream)
 		method=value[1],
 		path=value[2],
 		version=value[3]}, Request_mt)
-	local headers, value = decode_headers(parser, stream)
+	local headers, value
+	if lazy then
+		err, headers, value = decode_view(parser, stream)
+		if err then return err end
+	else
+		headers, value = decode_headers(parser, stream)
+	end
 	req.headers = headers
 	local len = decode_len(value)
 	if len then req.len = len end
@@ -265,7 +502,7 @@ local function decode_request(parser, stream)
 end
 
 
-local function decode_response(parser, stream)
+local function decode_response(parser, stream, lazy)
 	parser:init_response()
 
 	local err, value = parser:stream_next(stream)
@@ -274,10 +511,17 @@ local function decode_response(parser, stream)
 	-- TODO version
 	local res = setmetatable(
 		{code=value[1], reason=value[2], version=value[3]}, Response_mt)
-	local headers, value = decode_headers(parser, stream)
+	local headers, value
+	if lazy then
+		err, headers, value = decode_view(parser, stream)
+		if err then return err end
+	else
+		headers, value = decode_headers(parser, stream)
+	end
 	res.headers = headers
 	local len = decode_len(value)
 	if len then res.len = len end
+	if value[2] then res.chunked = true end
 
 	return nil, res
 end
@@ -316,7 +560,7 @@ end
 
 
 function P_mt:read_request()
-	return decode_request(self.parser, self.p)
+	return decode_request(self.parser, self.p, self.lazy)
 end
 
 
@@ -375,19 +619,22 @@ local function body_chunk_proxy(self, target)
 end
 
 
-function P_mt:read_response()
-	local err, res = decode_response(self.parser, self.p)
-	if err then return err end
-
+local function body_frame(p, res)
 	if res.len then
-		res.body = self.p:chunk(res.len)
+		res.body = p:chunk(res.len)
 		res.body.proxy = body_content_proxy
 	else
-		res.body = self.p:chunk(0)
+		res.body = p:chunk(0)
 		res.body.readin = body_chunk_readin
 		res.body.proxy = body_chunk_proxy
 	end
+end
+
 
+function P_mt:read_response()
+	local err, res = decode_response(self.parser, self.p, self.lazy)
+	if err then return err end
+	body_frame(self.p, res)
 	return nil, res
 end
 
@@ -399,13 +646,17 @@ end
 
 local _ = require("levee._")
 
-function P_mt:write_request(method, path, params, headers, body)
+function P_mt:encode_request(method, path, params, headers, body)
 	headers = headers or {}
 	if self.options.Host and not headers.Host then
 		headers.Host = self.options.Host
 	end
+	return M.encode_request(self.p.wbuf, method, path, params, headers, body)
+end
+
 
-	local err = M.encode_request(self.p.wbuf, method, path, params, headers, body)
+function P_mt:write_request(method, path, params, headers, body)
+	local err = self:encode_request(method, path, params, headers, body)
 	if err then return err end
 	local err, n = self.p.io:write(self.p.wbuf:value())
 	self.p.wbuf:trim()
@@ -446,6 +697,11 @@ end
 
 
 function P_mt:write_response(status, headers, body)
+	local hub = self.p.hub
+	if hub then
+		headers = headers or {}
+		if not headers["Date"] then headers["Date"] = hub.http.prelude:date() end
+	end
 	local err = M.encode_response(self.p.wbuf, status, headers, body)
 	if err then return err end
 	local err, n = self.p.io:write(self.p.wbuf:value())
@@ -463,11 +719,248 @@ function P_mt:write_chunk(chunk)
 end
 
 
+--
+-- Pipeline
+
+-- Sends requests on a connection without waiting for their responses, up to
+-- `window` in flight at a time. Queued requests are written back to back with
+-- a single write, and their responses are matched to them in order. Each
+-- response's body must be read, or it's discarded, before the next response
+-- is received.
+--
+-- A response with `Connection: close` ends the pipeline; requests that were in
+-- flight behind it, or still queued, are left unanswered and can be retried on
+-- another connection.
+
+local Pipeline_mt = {}
+Pipeline_mt.__index = Pipeline_mt
+
+
+function Pipeline_mt:__tostring()
+	return ("levee.http.0_4.Pipeline: inflight=%s queued=%s"):format(
+		#self.inflight, #self.queued)
+end
+
+
+function Pipeline_mt:request(method, path, options)
+	if self.closed then return errors.CLOSED end
+	options = options or {}
+	table.insert(self.queued, {
+		method = method,
+		path = path,
+		params = options.params,
+		headers = options.headers,
+		data = options.data, })
+end
+
+
+function Pipeline_mt:get(path, options)
+	return self:request("GET", path, options)
+end
+
+
+function Pipeline_mt:head(path, options)
+	return self:request("HEAD", path, options)
+end
+
+
+function Pipeline_mt:put(path, options)
+	return self:request("PUT", path, options)
+end
+
+
+function Pipeline_mt:post(path, options)
+	return self:request("POST", path, options)
+end
+
+
+-- encoding fills in a request's default headers and sets its length. it's
+-- given a copy, so a request returned by `unanswered` is as it was made and
+-- can be sent again. a d.Map can't be copied; encoding it again only sets the
+-- fields it set before
+local function copy_headers(headers)
+	if not headers then return end
+	if getmetatable(headers) == View_mt then
+		if rawget(headers, "_map") then return headers end
+		return View(headers._block, headers._spans, headers._common, headers._n)
+	end
+	if type(headers) == "cdata" then return headers end
+	local copy = {}
+	for k, v in pairs(headers) do copy[k] = v end
+	return copy
+end
+
+
+-- writes as many queued requests as fit in the window. returns the error if
+-- a request couldn't be encoded; it's left for `unanswered`
+function Pipeline_mt:flush()
+	if self.closed then return errors.CLOSED end
+	local n, failed = 0
+	while #self.queued > 0 and #self.inflight < self.window do
+		local req = self.queued[1]
+		failed = self.http:encode_request(
+			req.method, req.path, req.params, copy_headers(req.headers), req.data)
+		table.remove(self.queued, 1)
+		if failed then
+			req.err = failed
+			table.insert(self.failed, req)
+			break
+		end
+		table.insert(self.inflight, req)
+		n = n + 1
+	end
+	if n > 0 then
+		self.writes = self.writes + 1
+		self.sent = self.sent + n
+		local err = self.http.p.io:write(self.http.p.wbuf:value())
+		self.http.p.wbuf:trim()
+		if err then
+			self.closed = true
+			return err
+		end
+	end
+	return failed
+end
+
+
+-- consumes whatever is left of the previous response's body, so the next
+-- response can be read
+local function discard(res)
+	local body = res.body
+	if res.len then
+		while body.len > 0 do
+			body:trim()
+			if body.len > 0 then
+				local err = body.p:readin(1)
+				if err then return err end
+			end
+		end
+		return
+	end
+
+	if not res.chunked then return end
+	while true do
+		local err = body:readin()
+		if err == errors.CLOSED then break end
+		if err then return err end
+		body:trim()
+	end
+
+	-- skip any of the last chunk's CRLF the parser left behind
+	local buf, len = body.p:value()
+	local n = 0
+	while n < len and (buf[n] == 13 or buf[n] == 10) do n = n + 1 end
+	if n > 0 then body.p:trim(n) end
+end
+
+
+-- returns `err`, `res` for the oldest request in flight. `res.request` is the
+-- request it answers. returns errors.CLOSED once every response has been
+-- received, or the connection has been closed
+function Pipeline_mt:recv()
+	if self.closed then return errors.CLOSED end
+
+	if self.current then
+		local err = discard(self.current)
+		self.current = nil
+		if err then
+			self.closed = true
+			return err
+		end
+	end
+
+	-- a request that couldn't be encoded is reported in place of a response;
+	-- recv can be called again for the rest
+	local err = self:flush()
+	if err then return err end
+
+	local req = self.inflight[1]
+	if not req then return errors.CLOSED end
+
+	local p = self.http.p
+	local err, res
+	while true do
+		err, res = decode_response(self.http.parser, p, self.http.lazy)
+		if err then
+			self.closed = true
+			return err
+		end
+		-- a 1xx is interim, and the request's final response follows it
+		if res.code < 100 or res.code >= 200 then break end
+		self.interim = self.interim + 1
+	end
+	table.remove(self.inflight, 1)
+	self.received = self.received + 1
+
+	res.request = req
+	if req.method == "HEAD" or res.code < 200 or
+			res.code == 204 or res.code == 304 then
+		-- these responses never have a body, whatever their headers say
+		res.len = nil
+		res.chunked = nil
+	end
+	if res.len or res.chunked then
+		body_frame(p, res)
+	else
+		res.body = p:chunk(0)
+	end
+	self.current = res
+
+	local connection = res.headers["Connection"]
+	if type(connection) == "table" then connection = table.concat(connection, ",") end
+	if connection and connection:lower():find("close", 1, true) then
+		self.closed = true
+	end
+
+	return nil, res
+end
+
+
+-- returns the requests that haven't been answered, in the order they were
+-- made. a request that couldn't be encoded has its error as `.err`
+function Pipeline_mt:unanswered()
+	local ret = {}
+	for __, req in ipairs(self.inflight) do table.insert(ret, req) end
+	for __, req in ipairs(self.failed) do table.insert(ret, req) end
+	for __, req in ipairs(self.queued) do table.insert(ret, req) end
+	return ret
+end
+
+
+function Pipeline_mt:stats()
+	return {
+		sent = self.sent,
+		received = self.received,
+		interim = self.interim,
+		failed = #self.failed,
+		writes = self.writes,
+		inflight = #self.inflight,
+		queued = #self.queued, }
+end
+
+
+function P_mt:pipeline(window)
+	return setmetatable({
+		http = self,
+		window = window or 16,
+		queued = {},
+		inflight = {},
+		failed = {},
+		sent = 0,
+		received = 0,
+		interim = 0,
+		writes = 0, }, Pipeline_mt)
+end
+
+
 function M.io(p)
 	local self = setmetatable({p=p, parser=M.Parser()}, P_mt)
 
 	self.options = {}
 
+	-- decode headers into Views rather than d.Maps
+	self.lazy = self.p.options and self.p.options.lazy_headers or false
+
 	if self.p.options and self.p.options.host then
 		local host = self.p.options.host
 		local port = self.p.options.port
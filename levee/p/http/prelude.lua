@@ -0,0 +1,96 @@
+local ffi = require('ffi')
+local C = ffi.C
+
+local Status = require("levee.p.http.status")
+
+
+--
+-- Date response header
+
+local http_time = ffi.new("time_t [1]")
+local http_date = nil
+local http_date_buf = ffi.new("char [32]")
+local http_tm = ffi.new("struct tm")
+
+-- `t` is the time in seconds; a hub's cached hub:time() saves a call to time()
+local function httpdate(t)
+	t = t or C.time(nil)
+	if t ~= http_time[0] then
+		http_time[0] = t
+		C.gmtime_r(http_time, http_tm)
+		local len = C.strftime(
+			http_date_buf, 32, "%a, %d %b %Y %H:%M:%S GMT", http_tm)
+		http_date = ffi.string(http_date_buf, len)
+	end
+	return http_date
+end
+
+
+local tv = ffi.new("struct timeval")
+
+-- ms until just past the wall clock's next second. hub:time() reads a coarse
+-- clock, which can trail the second by a few ms
+local function tonext()
+	C.gettimeofday(tv, nil)
+	return math.ceil(1000 - tonumber(tv.tv_usec) / 1000) + 10
+end
+
+
+--
+-- Prelude
+
+-- The bytes every response starts with, kept per hub so they're formatted once
+-- rather than for each response: status lines, which `Status` preformats for
+-- every status it knows, and the Date header's value, refreshed on each
+-- second by a timer. The timer only runs while responses are being sent; once
+-- a second passes without the date being asked for, it stops, and the next
+-- response refreshes the date and starts it again.
+
+local Prelude_mt = {}
+Prelude_mt.__index = Prelude_mt
+
+
+function Prelude_mt:_refresh()
+	self.value = httpdate(self.hub:time())
+end
+
+
+function Prelude_mt:_tick()
+	while self.used do
+		self.used = false
+		self.hub:sleep(tonext())
+		self.refreshes = self.refreshes + 1
+		self:_refresh()
+	end
+	self.ticking = false
+end
+
+
+-- returns the current value for a Date header
+function Prelude_mt:date()
+	if not self.ticking then
+		self.ticking = true
+		self:_refresh()
+		self.hub:spawn_later(0, function() self:_tick() end)
+	end
+	self.used = true
+	return self.value
+end
+
+
+-- returns the status line for `status`, a Status or a code
+function Prelude_mt:status(status)
+	if type(status) == "number" then status = Status(status) end
+	return tostring(status)
+end
+
+
+local function Prelude(hub)
+	return setmetatable({hub = hub, refreshes = 0}, Prelude_mt)
+end
+
+
+return {
+	Prelude = Prelude,
+	httpdate = httpdate,
+}
@@ -109,4 +109,9 @@ Status[524] = Status(524, "A timeout occurred")
 Status[598] = Status(598, "Network read timeout error")
 Status[599] = Status(599, "Network connect timeout error")
 
+-- format each known status line up front, so responses never have to
+for code, status in pairs(Status) do
+	if type(code) == "number" then tostring(status) end
+end
+
 return Status
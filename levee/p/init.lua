@@ -45,11 +45,12 @@ end
 
 
 local ctype_buffer = ffi.typeof("LeveeBuffer")
+local ctype_mirror = ffi.typeof("LeveeMirror")
 
 
 local function StringStream(s, len)
 	local buf, n
-	if ffi.istype(ctype_buffer, s) then
+	if ffi.istype(ctype_buffer, s) or ffi.istype(ctype_mirror, s) then
 		buf, n = s:value()
 	else
 		buf = ffi.cast("uint8_t *", s)
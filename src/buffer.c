@@ -0,0 +1,236 @@
+#include "buffer.h"
+#include "list.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+
+#define MIN_SHIFT 13 /* log2 of LEVEE_BUFFER_MIN_SIZE */
+
+typedef struct {
+	pthread_mutex_t lock;
+	LeveeNode *free;
+	uint32_t count, limit;
+	uint64_t hits, misses, puts, drops;
+} Class;
+
+#define CLASS(shift) { \
+	PTHREAD_MUTEX_INITIALIZER, NULL, 0, \
+	LEVEE_BUFFER_POOL_BYTES >> (shift), 0, 0, 0, 0 \
+}
+
+static Class classes[LEVEE_BUFFER_POOL_CLASSES] = {
+	CLASS (13), CLASS (14), CLASS (15), CLASS (16), CLASS (17)
+};
+
+static int class_of (uint32_t cap);
+static int mirror_fd (void);
+
+uint8_t *
+levee_buffer_pool_get (uint32_t cap)
+{
+	int cls = class_of (cap);
+	if (cls < 0) {
+		return malloc (cap);
+	}
+
+	Class *c = &classes[cls];
+	LeveeNode *node;
+
+	pthread_mutex_lock (&c->lock);
+	node = c->free;
+	if (node != NULL) {
+		c->free = node->next;
+		c->count--;
+		c->hits++;
+	}
+	else {
+		c->misses++;
+	}
+	pthread_mutex_unlock (&c->lock);
+
+	if (node == NULL) {
+		return malloc (cap);
+	}
+	return (uint8_t *)node;
+}
+
+void
+levee_buffer_pool_put (uint8_t *block, uint32_t cap)
+{
+	if (block == NULL) {
+		return;
+	}
+
+	int cls = class_of (cap);
+	if (cls < 0) {
+		free (block);
+		return;
+	}
+
+	Class *c = &classes[cls];
+	LeveeNode *node = (LeveeNode *)block;
+	bool keep;
+
+	pthread_mutex_lock (&c->lock);
+	keep = c->count < c->limit;
+	if (keep) {
+		node->next = c->free;
+		c->free = node;
+		c->count++;
+		c->puts++;
+	}
+	else {
+		c->drops++;
+	}
+	pthread_mutex_unlock (&c->lock);
+
+	if (!keep) {
+		free (block);
+	}
+}
+
+void
+levee_buffer_pool_stats (LeveeBufferPoolStats *stats)
+{
+	assert (stats != NULL);
+
+	memset (stats, 0, sizeof *stats);
+	for (int i = 0; i < LEVEE_BUFFER_POOL_CLASSES; i++) {
+		Class *c = &classes[i];
+		pthread_mutex_lock (&c->lock);
+		stats->hits += c->hits;
+		stats->misses += c->misses;
+		stats->puts += c->puts;
+		stats->drops += c->drops;
+		stats->cached += c->count;
+		stats->bytes += (uint64_t)c->count << (MIN_SHIFT + i);
+		pthread_mutex_unlock (&c->lock);
+	}
+}
+
+void
+levee_buffer_pool_clear (void)
+{
+	for (int i = 0; i < LEVEE_BUFFER_POOL_CLASSES; i++) {
+		Class *c = &classes[i];
+		LeveeNode *node;
+
+		pthread_mutex_lock (&c->lock);
+		node = c->free;
+		c->free = NULL;
+		c->count = 0;
+		pthread_mutex_unlock (&c->lock);
+
+		while (node != NULL) {
+			LeveeNode *next = node->next;
+			free (node);
+			node = next;
+		}
+	}
+}
+
+uint8_t *
+levee_buffer_mirror_map (uint32_t cap)
+{
+	if (cap == 0 || cap % (uint32_t)getpagesize () != 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	int fd = mirror_fd ();
+	if (fd < 0) {
+		return NULL;
+	}
+
+	uint8_t *block = MAP_FAILED;
+	int err = 0;
+
+	if (ftruncate (fd, cap) < 0) {
+		err = errno;
+		goto out;
+	}
+
+	/* reserve both halves first so nothing else can be mapped between them */
+	block = mmap (NULL, (size_t)cap * 2, PROT_NONE, MAP_PRIVATE|MAP_ANON, -1, 0);
+	if (block == MAP_FAILED) {
+		err = errno;
+		goto out;
+	}
+
+	if (mmap (block, cap, PROT_READ|PROT_WRITE,
+				MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED ||
+			mmap (block + cap, cap, PROT_READ|PROT_WRITE,
+				MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED) {
+		err = errno;
+		munmap (block, (size_t)cap * 2);
+		block = MAP_FAILED;
+	}
+
+out:
+	/* the mappings keep the pages alive */
+	close (fd);
+	if (block == MAP_FAILED) {
+		errno = err;
+		return NULL;
+	}
+	return block;
+}
+
+void
+levee_buffer_mirror_unmap (uint8_t *block, uint32_t cap)
+{
+	if (block != NULL) {
+		munmap (block, (size_t)cap * 2);
+	}
+}
+
+static int
+mirror_fd (void)
+{
+#ifdef __linux__
+	return syscall (SYS_memfd_create, "levee-mirror", 1U /* MFD_CLOEXEC */);
+#else
+	/* an anonymous posix shm object, unlinked as soon as it's open */
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+	char name[32] = "/levee-mirror-";
+	size_t len = strlen (name);
+
+	for (int attempt = 0; attempt < 16; attempt++) {
+		for (size_t i = len; i < len + 8; i++) {
+			name[i] = chars[(size_t)random () % (sizeof chars - 1)];
+		}
+		name[len + 8] = '\0';
+
+		int fd = shm_open (name, O_RDWR|O_CREAT|O_EXCL, 0600);
+		if (fd >= 0) {
+			shm_unlink (name);
+			return fd;
+		}
+		if (errno != EEXIST) {
+			return -1;
+		}
+	}
+	return -1;
+#endif
+}
+
+static int
+class_of (uint32_t cap)
+{
+	/* only the power of 2 capacities Buffer grows through are pooled */
+	if (cap < LEVEE_BUFFER_MIN_SIZE || cap > LEVEE_BUFFER_MAX_BLOCK ||
+			(cap & (cap - 1)) != 0) {
+		return -1;
+	}
+	return __builtin_ctz (cap) - MIN_SHIFT;
+}
@@ -1,3 +1,8 @@
+#ifndef LEVEE_BUFFER_H
+#define LEVEE_BUFFER_H
+
+#include <stdint.h>
+
 static const unsigned LEVEE_BUFFER_MIN_SIZE = 8192;
 static const unsigned LEVEE_BUFFER_MAX_BLOCK = 131072;
 
@@ -6,3 +11,51 @@ typedef struct {
 	uint32_t off, len, cap, sav;
 } LeveeBuffer;
 
+/*
+ * A process wide pool of buffer blocks, one free list per power of 2 capacity
+ * from LEVEE_BUFFER_MIN_SIZE up to LEVEE_BUFFER_MAX_BLOCK. Blocks are plain
+ * malloc allocations with no header, so a buffer filled on one thread can be
+ * handed to another and put back from there, and a block that escapes the
+ * pool can still be released with free. Each class holds at most
+ * LEVEE_BUFFER_POOL_BYTES worth of idle blocks.
+ */
+
+#define LEVEE_BUFFER_POOL_CLASSES 5
+#define LEVEE_BUFFER_POOL_BYTES (4 * 1024 * 1024)
+
+typedef struct {
+	uint64_t hits;   /* blocks served from the pool */
+	uint64_t misses; /* blocks that fell through to malloc */
+	uint64_t puts;   /* blocks returned to the pool */
+	uint64_t drops;  /* blocks freed as their class was full */
+	uint64_t cached; /* blocks currently idle in the pool */
+	uint64_t bytes;  /* bytes currently idle in the pool */
+} LeveeBufferPoolStats;
+
+extern uint8_t *
+levee_buffer_pool_get (uint32_t cap);
+
+extern void
+levee_buffer_pool_put (uint8_t *block, uint32_t cap);
+
+extern void
+levee_buffer_pool_stats (LeveeBufferPoolStats *stats);
+
+extern void
+levee_buffer_pool_clear (void);
+
+/*
+ * A mirrored block maps the same pages twice, back to back, so `cap` bytes
+ * starting anywhere in the first half are contiguous in memory. A buffer kept
+ * in one can trim by moving its offset around the block, without ever moving
+ * its contents down. cap must be a multiple of the page size. Returns NULL and
+ * sets errno on failure.
+ */
+
+extern uint8_t *
+levee_buffer_mirror_map (uint32_t cap);
+
+extern void
+levee_buffer_mirror_unmap (uint8_t *block, uint32_t cap);
+
+#endif
@@ -1,10 +1,12 @@
 #include "chan.h"
+#include "pool.h"
 
 #include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include <siphon/crc.h>
 
@@ -16,7 +18,7 @@
 } while (0)
 
 #define CREATE_NODE(id, typ, err, key, val) __extension__ ({          \
-	LeveeChanNode *node = malloc (sizeof *node);                      \
+	LeveeChanNode *node = levee_pool_alloc (sizeof *node);            \
 	if (node != NULL) {                                               \
 		node->recv_id = id;                                           \
 		node->type = typ;                                             \
@@ -114,6 +116,87 @@ notify (LeveeChan *self)
 
 #endif
 
+static int
+space_init (LeveeChan *self)
+{
+	if (pipe (self->space) < 0) {
+		return -1;
+	}
+	for (int i = 0; i < 2; i++) {
+		int flags = fcntl (self->space[i], F_GETFL);
+		if (flags < 0 ||
+				fcntl (self->space[i], F_SETFL, flags | O_NONBLOCK) < 0 ||
+				fcntl (self->space[i], F_SETFD, FD_CLOEXEC) < 0) {
+			close (self->space[0]);
+			close (self->space[1]);
+			self->space[0] = self->space[1] = -1;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void
+space_final (LeveeChan *self)
+{
+	if (self->space[0] >= 0) {
+		close (self->space[0]);
+		close (self->space[1]);
+	}
+}
+
+static void
+space_notify (LeveeChan *self)
+{
+	if (self->space[0] < 0) {
+		return;
+	}
+
+	// empty the pipe first so the write is always a fresh edge for the
+	// senders' pollers
+	char buf[64];
+	while (read (self->space[0], buf, sizeof buf) > 0) {
+	}
+	if (write (self->space[1], "", 1) < 0 && errno != EAGAIN) {
+		fprintf (stderr, "failed to write to space pipe: %s\n", strerror (errno));
+	}
+}
+
+/*
+ * Reserves room for a message. Fails when a bounded channel is at capacity,
+ * marking the channel as blocked so the receiver signals space once it drains.
+ */
+static int
+reserve (LeveeChan *self)
+{
+	for (;;) {
+		int64_t depth = __sync_add_and_fetch (&self->depth, 1);
+		if (self->capacity == 0 || depth <= self->capacity) {
+			int64_t hw = self->high_water;
+			while (depth > hw &&
+					!__sync_bool_compare_and_swap (&self->high_water, hw, depth)) {
+				hw = self->high_water;
+			}
+			return 0;
+		}
+		__sync_sub_and_fetch (&self->depth, 1);
+
+		// mark blocked before checking depth again, as the receiver lowers depth
+		// before checking blocked, so one of us sees the other
+		__sync_fetch_and_or (&self->blocked, 1);
+		if (self->depth >= self->capacity) {
+			__sync_add_and_fetch (&self->refused, 1);
+			return -1;
+		}
+	}
+}
+
+static inline bool
+is_control (LeveeChanNode *node)
+{
+	return node->type == LEVEE_CHAN_EOF || node->type == LEVEE_CHAN_SND;
+}
+
 static void
 destroy_node (LeveeChanNode *node)
 {
@@ -124,7 +207,7 @@ destroy_node (LeveeChanNode *node)
 	else if (node->type == LEVEE_CHAN_SND) {
 		levee_chan_sender_unref (node->as.sender);
 	}
-	free (node);
+	levee_pool_free (node);
 }
 
 static int
@@ -133,8 +216,20 @@ send_node (LeveeChanSender *self, LeveeChanNode *node)
 	if (!self->eof) {
 		LeveeChan *ch = levee_chan_ref (self->chan);
 		if (ch != NULL) {
-			levee_list_push (&ch->msg, &node->base);
-			notify (ch);
+			// eof and connect messages aren't held back by capacity
+			if (!is_control (node) && reserve (ch) < 0) {
+				levee_chan_unref (self->chan);
+				// the caller keeps ownership of the value
+				levee_pool_free (node);
+				errno = EAGAIN;
+				return -1;
+			}
+			levee_queue_push (&ch->msg, &node->base);
+			// only the first send since the receiver last drained needs to wake it
+			if (__sync_bool_compare_and_swap (&ch->armed, 1, 0)) {
+				__sync_add_and_fetch (&ch->notifies, 1);
+				notify (ch);
+			}
 			levee_chan_unref (self->chan);
 			return 0;
 		}
@@ -146,19 +241,33 @@ send_node (LeveeChanSender *self, LeveeChanNode *node)
 }
 
 LeveeRef *
-levee_chan_create (int loopfd)
+levee_chan_create (int loopfd, uint32_t capacity)
 {
 	LeveeChan *self = malloc (sizeof *self);
 	if (self == NULL) {
 		return NULL;
 	}
 
-	levee_list_init (&self->msg);
+	levee_queue_init (&self->msg);
 	levee_list_init (&self->senders);
 	self->recv_id = 0;
 	self->loopfd = loopfd;
+	self->armed = 1;
+	self->notifies = 0;
+	self->capacity = capacity;
+	self->blocked = 0;
+	self->space[0] = self->space[1] = -1;
+	self->depth = 0;
+	self->high_water = 0;
+	self->refused = 0;
+
+	if (capacity > 0 && space_init (self) < 0) {
+		free (self);
+		return NULL;
+	}
 
 	if (init (self) < 0) {
+		space_final (self);
 		free (self);
 		return NULL;
 	}
@@ -166,6 +275,7 @@ levee_chan_create (int loopfd)
 	LeveeRef *ref = levee_ref_make (self);
 	if (ref == NULL) {
 		final (self);
+		space_final (self);
 		free (self);
 	}
 	return ref;
@@ -194,14 +304,13 @@ levee_chan_unref (LeveeRef *self)
 		return;
 	}
 
-	LeveeNode *node = levee_list_drain (&ch->msg, false);
-	while (node != NULL) {
-		LeveeNode *next = node->next;
+	LeveeNode *node;
+	while ((node = levee_queue_pop (&ch->msg)) != NULL) {
 		destroy_node (container_of (node, LeveeChanNode, base));
-		node = next;
 	}
 
 	final (ch);
+	space_final (ch);
 	free (ch);
 }
 
@@ -226,6 +335,9 @@ levee_chan_close (LeveeRef *self)
 
 	close (id);
 
+	// wake any senders waiting for space so they see the channel has closed
+	space_notify (ch);
+
 	LeveeNode *node = levee_list_drain (&ch->senders, false);
 	while (node != NULL) {
 		LeveeNode *next = node->next;
@@ -265,6 +377,39 @@ levee_chan_next_recv_id (LeveeRef *self)
 	return id;
 }
 
+int
+levee_chan_stats (LeveeRef *self, LeveeChanStats *stats)
+{
+	assert (self != NULL);
+	assert (stats != NULL);
+
+	LeveeChan *ch = levee_chan_ref (self);
+	if (ch == NULL) {
+		return -1;
+	}
+	stats->notifies = ch->notifies;
+	stats->capacity = ch->capacity;
+	stats->depth = ch->depth;
+	stats->high_water = ch->high_water;
+	stats->refused = ch->refused;
+	levee_chan_unref (self);
+	return 0;
+}
+
+int
+levee_chan_space_id (LeveeRef *self)
+{
+	assert (self != NULL);
+
+	int id = -1;
+	LeveeChan *ch = levee_chan_ref (self);
+	if (ch != NULL) {
+		id = ch->space[0];
+		levee_chan_unref (self);
+	}
+	return id;
+}
+
 LeveeChanSender *
 levee_chan_sender_create (LeveeRef *self, int64_t recv_id)
 {
@@ -320,7 +465,7 @@ levee_chan_sender_close (LeveeChanSender *self)
 	assert (self != NULL);
 
 	if (!self->eof) {
-		LeveeChanNode *node = malloc (sizeof *node);
+		LeveeChanNode *node = levee_pool_alloc (sizeof *node);
 		if (node == NULL) {
 			return -1;
 		}
@@ -341,7 +486,7 @@ levee_chan_send_nil (LeveeChanSender *self, int err)
 
 	VERIFY_EOF (self);
 
-	LeveeChanNode *node = malloc (sizeof *node);
+	LeveeChanNode *node = levee_pool_alloc (sizeof *node);
 	if (node == NULL) {
 		return -1;
 	}
@@ -449,7 +594,7 @@ levee_chan_connect (LeveeChanSender *self, LeveeRef *chan)
 	node = NULL;
 
 out:
-	free (node);
+	levee_pool_free (node);
 	free (sender);
 	errno = err;
 	return id;
@@ -470,25 +615,35 @@ levee_chan_recv (LeveeRef *self)
 			fprintf (stderr, "failed to read to eventfd: %s\n", strerror (errno));
 		}
 #endif
-		LeveeNode *tail = levee_list_drain (&chan->msg, false);
-
-		// reverse the list and register any connect messages
-		if (tail != NULL) {
-			LeveeNode *root = tail, *next = NULL;
-			tail = NULL;
+		// re-arm before draining so a send racing with the drain still notifies
+		__sync_fetch_and_or (&chan->armed, 1);
+		// chain the popped nodes for recv_next and register any connect messages
+		LeveeNode *head = levee_queue_pop (&chan->msg), *last = head;
+		if (head != NULL) {
+			int64_t drained = 0;
+			LeveeNode *root = head;
 			do {
 				LeveeChanNode *n = container_of (root, LeveeChanNode, base);
 				if (n->type == LEVEE_CHAN_SND) {
 					levee_list_push (&chan->senders, &n->as.sender->node);
 				}
-				next = root->next;
-				root->next = tail;
-				tail = root;
-				root = next;
+				if (!is_control (n)) {
+					drained++;
+				}
+				root = levee_queue_pop (&chan->msg);
+				last->next = root;
+				if (root != NULL) {
+					last = root;
+				}
 			} while (root != NULL);
+
+			__sync_sub_and_fetch (&chan->depth, drained);
+			if (chan->blocked && __sync_bool_compare_and_swap (&chan->blocked, 1, 0)) {
+				space_notify (chan);
+			}
 		}
 
-		node = container_of (tail, LeveeChanNode, base);
+		node = container_of (head, LeveeChanNode, base);
 		levee_chan_unref (self);
 	}
 	return node;
@@ -55,12 +55,28 @@ typedef struct {
 } LeveeChanNode;
 
 struct LeveeChan {
-	LeveeList msg, senders;
+	LeveeQueue msg;
+	LeveeList senders;
 	int64_t recv_id;
 	int64_t chan_id;
 	int loopfd;
+	int armed;         /* set when the next send must notify the receiver */
+	uint64_t notifies;
+	uint32_t capacity; /* max undrained messages, or 0 for unbounded */
+	int blocked;       /* set when a send has been refused for capacity */
+	int space[2];      /* pipe written when refused senders may retry */
+	int64_t depth, high_water;
+	uint64_t refused;
 };
 
+typedef struct {
+	uint64_t notifies;   /* eventfd writes or kevent triggers issued */
+	uint32_t capacity;
+	int64_t depth;       /* messages sent and not yet drained */
+	int64_t high_water;  /* the largest depth seen */
+	uint64_t refused;    /* sends refused with EAGAIN at capacity */
+} LeveeChanStats;
+
 struct LeveeChanSender {
 	LeveeNode node;
 	LeveeRef *chan;
@@ -70,7 +86,7 @@ struct LeveeChanSender {
 };
 
 extern LeveeRef *
-levee_chan_create (int loopfd);
+levee_chan_create (int loopfd, uint32_t capacity);
 
 extern LeveeChan *
 levee_chan_ref (LeveeRef *self);
@@ -87,6 +103,12 @@ levee_chan_event_id (LeveeRef *self);
 extern int64_t
 levee_chan_next_recv_id (LeveeRef *self);
 
+extern int
+levee_chan_stats (LeveeRef *self, LeveeChanStats *stats);
+
+extern int
+levee_chan_space_id (LeveeRef *self);
+
 extern LeveeChanSender *
 levee_chan_sender_create (LeveeRef *self, int64_t recv_id);
 
@@ -3,9 +3,11 @@
 #include <unistd.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <netdb.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -15,88 +17,418 @@
 #include "dialer.h"
 
 
-struct LeveeDialerState levee_dialer_state;
-
-
-struct LeveeDialerResponse {
+struct LeveeDialerEntry {
+	LeveeDialerEntry *next;
+	int refs;
 	int err;
 	struct addrinfo *info;
+	int64_t expires;
+	uint32_t hash;
+	uint16_t family;
+	uint16_t socktype;
+	char key[]; /* the node and then the service, each NUL terminated */
 };
 
 
-void *
-levee_dialer_loop () {
-	sigset_t set;
-	sigfillset (&set);
-	pthread_sigmask (SIG_SETMASK, &set, NULL);
+struct LeveeDialerRequest {
+	struct LeveeDialerRequest *next;
+	uint32_t id;
+	int no;
+	uint16_t family;
+	uint16_t socktype;
+	char node[256];
+	char service[32];
+};
 
-	int rc;
 
-	struct LeveeDialerRequest req;
-	struct LeveeDialerResponse res;
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	struct LeveeDialerRequest *head, *tail;
+	uint32_t ttl, negative_ttl;
+	LeveeDialerStats stats;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.ready = PTHREAD_COND_INITIALIZER,
+	.ttl = LEVEE_DIALER_TTL,
+	.negative_ttl = LEVEE_DIALER_NEGATIVE_TTL,
+};
 
-	char node[256];
-	char service[32];
 
-	struct addrinfo hints;
+static struct {
+	pthread_mutex_t lock;
+	LeveeDialerEntry *buckets[LEVEE_DIALER_BUCKETS];
+	LeveeDialerStats stats;
+} cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
 
-	while (1) {
-		memset (&hints, 0, sizeof (hints));
-		memset (&res, 0, sizeof (res));
 
-		rc = read (levee_dialer_state.io[0], &req, sizeof (req));
-		assert (rc == sizeof (req));
-		assert (req.node_len < sizeof (node));
-		assert (req.service_len < sizeof (service));
+struct LeveeDialerState levee_dialer_state;
+
+
+static int64_t
+now_us (void) {
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static uint32_t
+hash_key (const char *node, const char *service,
+		uint16_t family, uint16_t socktype) {
+	/* FNV-1a over both strings, including their terminators */
+	uint32_t h = 2166136261u;
+	do { h = (h ^ (uint8_t)*node) * 16777619u; } while (*node++);
+	do { h = (h ^ (uint8_t)*service) * 16777619u; } while (*service++);
+	h = (h ^ family) * 16777619u;
+	h = (h ^ socktype) * 16777619u;
+	return h;
+}
+
+
+static int
+entry_match (const LeveeDialerEntry *e, uint32_t hash, const char *node,
+		const char *service, uint16_t family, uint16_t socktype) {
+	return e->hash == hash && e->family == family && e->socktype == socktype &&
+		strcmp (e->key, node) == 0 &&
+		strcmp (e->key + strlen (e->key) + 1, service) == 0;
+}
+
+
+static LeveeDialerEntry *
+entry_new (const struct LeveeDialerRequest *req, int err,
+		struct addrinfo *info) {
+	size_t node_len = strlen (req->node) + 1;
+	size_t service_len = strlen (req->service) + 1;
+
+	LeveeDialerEntry *e = malloc (sizeof *e + node_len + service_len);
+	if (e == NULL) return NULL;
+
+	e->next = NULL;
+	e->refs = 1;
+	e->err = err;
+	e->info = info;
+	e->expires = 0;
+	e->hash = hash_key (req->node, req->service, req->family, req->socktype);
+	e->family = req->family;
+	e->socktype = req->socktype;
+	memcpy (e->key, req->node, node_len);
+	memcpy (e->key + node_len, req->service, service_len);
+	return e;
+}
 
-		rc = read (levee_dialer_state.io[0], node, req.node_len);
-		assert (rc == req.node_len);
-		node[req.node_len] = 0;
 
-		rc = read (levee_dialer_state.io[0], service, req.service_len);
-		assert (rc == req.service_len);
-		service[req.service_len] = 0;
+void
+levee_dialer_release (LeveeDialerEntry *entry) {
+	if (entry == NULL) return;
+	if (__sync_sub_and_fetch (&entry->refs, 1) == 0) {
+		if (entry->info != NULL) freeaddrinfo (entry->info);
+		free (entry);
+	}
+}
 
-		hints.ai_family = req.family;
-		hints.ai_socktype = req.socktype;
 
-		rc = getaddrinfo (node, service, &hints, &res.info);
-		if (rc != 0) {
-			res.err = SP_EAI_CODE(rc);
+/* drops expired entries from every bucket; call with the cache lock held */
+static void
+cache_sweep (int64_t now) {
+	for (int i = 0; i < LEVEE_DIALER_BUCKETS; i++) {
+		LeveeDialerEntry **p = &cache.buckets[i];
+		while (*p != NULL) {
+			LeveeDialerEntry *e = *p;
+			if (e->expires > now) {
+				p = &e->next;
+				continue;
+			}
+			*p = e->next;
+			cache.stats.cached--;
+			levee_dialer_release (e);
 		}
+	}
+}
+
+
+static void
+cache_insert (LeveeDialerEntry *entry, uint32_t ttl) {
+	int64_t now = now_us ();
+	const char *service = entry->key + strlen (entry->key) + 1;
 
-		rc = write (req.no, &res, sizeof (res));
-		assert (rc == sizeof (res));
+	pthread_mutex_lock (&cache.lock);
+
+	if (cache.stats.cached >= LEVEE_DIALER_CACHE_MAX) {
+		cache_sweep (now);
+		if (cache.stats.cached >= LEVEE_DIALER_CACHE_MAX) {
+			pthread_mutex_unlock (&cache.lock);
+			return;
+		}
 	}
+
+	LeveeDialerEntry **p = &cache.buckets[entry->hash % LEVEE_DIALER_BUCKETS];
+	while (*p != NULL) {
+		LeveeDialerEntry *e = *p;
+		if (entry_match (e, entry->hash, entry->key, service,
+				entry->family, entry->socktype)) {
+			*p = e->next;
+			cache.stats.cached--;
+			levee_dialer_release (e);
+			break;
+		}
+		p = &e->next;
+	}
+
+	entry->expires = now + (int64_t)ttl * 1000;
+	__sync_add_and_fetch (&entry->refs, 1);
+	entry->next = cache.buckets[entry->hash % LEVEE_DIALER_BUCKETS];
+	cache.buckets[entry->hash % LEVEE_DIALER_BUCKETS] = entry;
+	cache.stats.cached++;
+
+	pthread_mutex_unlock (&cache.lock);
 }
 
 
 int
-levee_dialer_boot (void) {
+levee_dialer_lookup (const char *node, const char *service,
+		uint16_t family, uint16_t socktype, struct LeveeDialerResponse *res) {
+	assert (node != NULL && service != NULL);
+	assert (res != NULL);
+
+	uint32_t hash = hash_key (node, service, family, socktype);
+	int64_t now = now_us ();
+	int hit = 0;
+
+	pthread_mutex_lock (&cache.lock);
+
+	LeveeDialerEntry **p = &cache.buckets[hash % LEVEE_DIALER_BUCKETS];
+	while (*p != NULL) {
+		LeveeDialerEntry *e = *p;
+		if (e->expires <= now) {
+			*p = e->next;
+			cache.stats.cached--;
+			levee_dialer_release (e);
+			continue;
+		}
+		if (entry_match (e, hash, node, service, family, socktype)) {
+			__sync_add_and_fetch (&e->refs, 1);
+			res->err = e->err;
+			res->id = 0;
+			res->info = e->info;
+			res->entry = e;
+			hit = 1;
+			break;
+		}
+		p = &e->next;
+	}
+
+	if (hit) {
+		cache.stats.hits++;
+		if (res->err != 0) cache.stats.negative++;
+	}
+	else {
+		cache.stats.misses++;
+	}
+
+	pthread_mutex_unlock (&cache.lock);
+	return hit;
+}
+
+
+static int
+cacheable (int rc) {
+	/* failures that may well succeed if tried again straight away */
+	return rc != EAI_AGAIN && rc != EAI_MEMORY && rc != EAI_SYSTEM;
+}
+
+
+static void
+resolve (struct LeveeDialerRequest *req) {
+	struct addrinfo hints;
+	struct addrinfo *info = NULL;
+	struct LeveeDialerResponse res;
+	uint32_t ttl;
+	int rc;
+
+	memset (&hints, 0, sizeof (hints));
+	memset (&res, 0, sizeof (res));
+	hints.ai_family = req->family;
+	hints.ai_socktype = req->socktype;
+
+	int64_t start = now_us ();
+	rc = getaddrinfo (req->node, req->service, &hints, &info);
+	uint64_t took = now_us () - start;
+	if (rc != 0) info = NULL;
+
+	pthread_mutex_lock (&pool.lock);
+	pool.stats.resolved++;
+	if (rc != 0) pool.stats.failed++;
+	pool.stats.latency += took;
+	if (took > pool.stats.latency_max) pool.stats.latency_max = took;
+	ttl = rc == 0 ? pool.ttl : pool.negative_ttl;
+	pthread_mutex_unlock (&pool.lock);
+
+	res.id = req->id;
+	res.entry = entry_new (req, rc ? SP_EAI_CODE (rc) : 0, info);
+	if (res.entry == NULL) {
+		if (info != NULL) freeaddrinfo (info);
+		res.err = SP_EAI_CODE (EAI_MEMORY);
+	}
+	else {
+		res.err = res.entry->err;
+		res.info = info;
+		if (ttl > 0 && cacheable (rc)) cache_insert (res.entry, ttl);
+	}
+
+	/* responses are well under PIPE_BUF, so writes from the resolver threads
+	 * never interleave. if the hub has gone away, its reference is ours */
+	rc = write (req->no, &res, sizeof (res));
+	if (rc != sizeof (res)) levee_dialer_release (res.entry);
+}
+
+
+static void *
+resolve_loop (void *arg) {
+	(void)arg;
+
+	sigset_t set;
+	sigfillset (&set);
+	pthread_sigmask (SIG_SETMASK, &set, NULL);
+
+	while (1) {
+		pthread_mutex_lock (&pool.lock);
+		while (pool.head == NULL) {
+			pthread_cond_wait (&pool.ready, &pool.lock);
+		}
+		struct LeveeDialerRequest *req = pool.head;
+		pool.head = req->next;
+		if (pool.head == NULL) pool.tail = NULL;
+		pool.stats.pending--;
+		pthread_mutex_unlock (&pool.lock);
+
+		resolve (req);
+		free (req);
+	}
+
+	return NULL;
+}
+
+
+/* starts resolver threads until there are n; call with the pool lock held */
+static int
+spawn (uint32_t n) {
 	pthread_t thr;
 	pthread_attr_t attr;
 	int rc;
 
-	rc = pipe (levee_dialer_state.io);
-	if (rc != 0) return -errno;
+	if (n > LEVEE_DIALER_MAX_THREADS) n = LEVEE_DIALER_MAX_THREADS;
+	if (pool.stats.threads >= n) return 0;
 
 	rc = pthread_attr_init (&attr);
-	if (rc != 0) return -errno;
+	if (rc != 0) return -rc;
 	rc = pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
-	if (rc != 0) return -errno;
-	rc = pthread_create (&thr, &attr, &levee_dialer_loop, NULL);
-	if (rc != 0) return -errno;
+	while (rc == 0 && pool.stats.threads < n) {
+		rc = pthread_create (&thr, &attr, &resolve_loop, NULL);
+		if (rc == 0) pool.stats.threads++;
+	}
+	pthread_attr_destroy (&attr);
+
+	/* a partial pool still serves requests, so only fail if there's none */
+	if (rc != 0 && pool.stats.threads == 0) return -rc;
+	return 0;
+}
+
+
+int
+levee_dialer_configure (uint32_t threads, uint32_t ttl, uint32_t negative_ttl) {
+	int rc;
+
+	pthread_mutex_lock (&pool.lock);
+	pool.ttl = ttl;
+	pool.negative_ttl = negative_ttl;
+	rc = spawn (threads);
+	pthread_mutex_unlock (&pool.lock);
+	return rc;
+}
+
+
+int
+levee_dialer_submit (const char *node, const char *service,
+		uint16_t family, uint16_t socktype, int no, uint32_t id) {
+	assert (node != NULL && service != NULL);
+
+	struct LeveeDialerRequest *req;
+	size_t node_len = strlen (node), service_len = strlen (service);
+
+	if (node_len >= sizeof (req->node) || service_len >= sizeof (req->service)) {
+		return -ENAMETOOLONG;
+	}
+
+	req = malloc (sizeof (*req));
+	if (req == NULL) return -errno;
+
+	req->next = NULL;
+	req->id = id;
+	req->no = no;
+	req->family = family;
+	req->socktype = socktype;
+	memcpy (req->node, node, node_len + 1);
+	memcpy (req->service, service, service_len + 1);
+
+	pthread_mutex_lock (&pool.lock);
+	if (pool.tail != NULL) {
+		pool.tail->next = req;
+	}
+	else {
+		pool.head = req;
+	}
+	pool.tail = req;
+	pool.stats.pending++;
+	pthread_cond_signal (&pool.ready);
+	pthread_mutex_unlock (&pool.lock);
 
 	return 0;
 }
 
 
+void
+levee_dialer_flush (void) {
+	pthread_mutex_lock (&cache.lock);
+	for (int i = 0; i < LEVEE_DIALER_BUCKETS; i++) {
+		LeveeDialerEntry *e = cache.buckets[i];
+		while (e != NULL) {
+			LeveeDialerEntry *next = e->next;
+			levee_dialer_release (e);
+			e = next;
+		}
+		cache.buckets[i] = NULL;
+	}
+	cache.stats.cached = 0;
+	pthread_mutex_unlock (&cache.lock);
+}
+
+
+void
+levee_dialer_stats (LeveeDialerStats *stats) {
+	assert (stats != NULL);
+
+	pthread_mutex_lock (&pool.lock);
+	*stats = pool.stats;
+	pthread_mutex_unlock (&pool.lock);
+
+	pthread_mutex_lock (&cache.lock);
+	stats->hits = cache.stats.hits;
+	stats->negative = cache.stats.negative;
+	stats->misses = cache.stats.misses;
+	stats->cached = cache.stats.cached;
+	pthread_mutex_unlock (&cache.lock);
+}
+
+
 pthread_once_t levee_dialer_once = PTHREAD_ONCE_INIT;
 
 
 void
 levee_dialer_run_once (void) {
-	levee_dialer_state.rc = levee_dialer_boot ();
+	pthread_mutex_lock (&pool.lock);
+	levee_dialer_state.rc = spawn (LEVEE_DIALER_THREADS);
+	pthread_mutex_unlock (&pool.lock);
 }
 
 
@@ -1,18 +1,75 @@
+#ifndef LEVEE_DIALER_H
+#define LEVEE_DIALER_H
+
+#include <stdint.h>
+
+/*
+ * Blocking getaddrinfo lookups run on a shared pool of resolver threads, fed
+ * from a request queue. Each hub submits requests along with the write end of
+ * a pipe and an id, and a resolver thread writes the LeveeDialerResponse back
+ * to that pipe once the lookup completes.
+ *
+ * Results, including failures that won't go away by retrying, are cached for
+ * a TTL keyed on the node, service, family and socktype, so repeated dials to
+ * the same upstream are answered by levee_dialer_lookup without a round trip
+ * through the pool. A cached result is shared: every response holds a
+ * reference to its entry, which must be given back with levee_dialer_release.
+ */
+
+#define LEVEE_DIALER_THREADS 4
+#define LEVEE_DIALER_MAX_THREADS 64
+#define LEVEE_DIALER_TTL 30000         /* ms to cache a successful lookup */
+#define LEVEE_DIALER_NEGATIVE_TTL 5000 /* ms to cache a failed lookup */
+#define LEVEE_DIALER_CACHE_MAX 4096
+#define LEVEE_DIALER_BUCKETS 256
+
+typedef struct LeveeDialerEntry LeveeDialerEntry;
+
 struct LeveeDialerState {
 	int rc;
-	int io[2];
 };
 
-
-struct LeveeDialerRequest {
-	uint16_t node_len;
-	uint16_t service_len;
-	uint16_t family;
-	uint16_t socktype;
-	uint8_t is_listening;
-	int no;
+struct LeveeDialerResponse {
+	int err;
+	uint32_t id;
+	struct addrinfo *info;
+	LeveeDialerEntry *entry;
 };
 
+typedef struct {
+	uint64_t hits;        /* lookups answered from the cache */
+	uint64_t negative;    /* of those, cached failures */
+	uint64_t misses;      /* lookups handed to the resolver threads */
+	uint64_t resolved;    /* getaddrinfo calls completed */
+	uint64_t failed;      /* of those, calls that returned an error */
+	uint64_t latency;     /* total time spent in getaddrinfo, in microseconds */
+	uint64_t latency_max; /* slowest getaddrinfo call, in microseconds */
+	uint32_t pending;     /* requests waiting for a resolver thread */
+	uint32_t threads;     /* resolver threads running */
+	uint32_t cached;      /* entries in the cache */
+} LeveeDialerStats;
 
 extern struct LeveeDialerState
-levee_dialer_init ();
+levee_dialer_init (void);
+
+extern int
+levee_dialer_configure (uint32_t threads, uint32_t ttl, uint32_t negative_ttl);
+
+extern int
+levee_dialer_lookup (const char *node, const char *service,
+		uint16_t family, uint16_t socktype, struct LeveeDialerResponse *res);
+
+extern int
+levee_dialer_submit (const char *node, const char *service,
+		uint16_t family, uint16_t socktype, int no, uint32_t id);
+
+extern void
+levee_dialer_release (LeveeDialerEntry *entry);
+
+extern void
+levee_dialer_flush (void);
+
+extern void
+levee_dialer_stats (LeveeDialerStats *stats);
+
+#endif
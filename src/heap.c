@@ -1,4 +1,5 @@
 #include "heap.h"
+#include "pool.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -85,13 +86,13 @@ levee_heap_add (LeveeHeap *self, int64_t pri)
 
 	uint32_t key;
 
-	LeveeHeapItem * item = malloc (sizeof(LeveeHeapItem));
+	LeveeHeapItem * item = levee_pool_alloc (sizeof(LeveeHeapItem));
 	if (item == NULL) {
 	    return NULL;
 	}
 
 	if (self->capacity == self->next && add_row (self) < 0) {
-		free (item);
+		levee_pool_free (item);
 		return NULL;
 	}
 
@@ -155,7 +156,7 @@ levee_heap_remove (LeveeHeap *self, uint32_t key)
 		return;
 	}
 
-	free (ENTRY (self, key).item);
+	levee_pool_free (ENTRY (self, key).item);
 
 	if (key != --self->next) {
 		ENTRY (self, key) = ENTRY (self, self->next);
@@ -181,7 +182,7 @@ levee_heap_clear (LeveeHeap *self)
 	assert (self != NULL);
 
 	for (uint32_t i = LEVEE_HEAP_ROOT_KEY; i < self->next; i++) {
-		free (ENTRY (self, i).item);
+		levee_pool_free (ENTRY (self, i).item);
 		ENTRY (self, i).item = NULL;
 	}
 
@@ -72,3 +72,66 @@ levee_list_drain (LeveeList *self, bool reverse)
 	return tail;
 }
 
+void
+levee_queue_init (LeveeQueue *self)
+{
+	assert (self != NULL);
+
+	self->stub.next = NULL;
+	self->head = &self->stub;
+	self->tail = &self->stub;
+}
+
+void
+levee_queue_push (LeveeQueue *self, LeveeNode *node)
+{
+	assert (self != NULL);
+	assert (node != NULL);
+
+	node->next = NULL;
+	LeveeNode *prev = __atomic_exchange_n (&self->head, node, __ATOMIC_ACQ_REL);
+	// until this store lands the consumer sees the queue end at prev
+	__atomic_store_n (&prev->next, node, __ATOMIC_RELEASE);
+}
+
+/*
+ * Pops the oldest node. Only one thread may pop at a time. Returns NULL when
+ * the queue is empty, or when the next node's producer has swapped the head
+ * but not yet linked it in; that producer's notify follows the link.
+ */
+LeveeNode *
+levee_queue_pop (LeveeQueue *self)
+{
+	assert (self != NULL);
+
+	LeveeNode *tail = self->tail;
+	LeveeNode *next = __atomic_load_n (&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == &self->stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		self->tail = next;
+		tail = next;
+		next = __atomic_load_n (&next->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next != NULL) {
+		self->tail = next;
+		return tail;
+	}
+
+	if (tail != __atomic_load_n (&self->head, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+
+	// tail is the last node: put the stub behind it so it can be handed out
+	levee_queue_push (self, &self->stub);
+
+	next = __atomic_load_n (&tail->next, __ATOMIC_ACQUIRE);
+	if (next != NULL) {
+		self->tail = next;
+		return tail;
+	}
+	return NULL;
+}
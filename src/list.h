@@ -14,6 +14,20 @@ struct LeveeNode {
 	LeveeNode *next;
 };
 
+typedef struct LeveeQueue LeveeQueue;
+
+/*
+ * An intrusive multi-producer, single-consumer FIFO (Vyukov). Producers only
+ * swap the head, and the consumer pops from the tail in order without walking
+ * or reversing the chain.
+ */
+struct LeveeQueue {
+	LeveeNode *head;  /* swapped by producers */
+	char pad[56];     /* keeps head and tail on separate cache lines */
+	LeveeNode *tail;  /* only touched by the consumer */
+	LeveeNode stub;
+};
+
 extern void
 levee_list_init (LeveeList *self);
 
@@ -26,5 +40,14 @@ levee_list_pop (LeveeList *self);
 extern LeveeNode *
 levee_list_drain (LeveeList *self, bool reverse);
 
+extern void
+levee_queue_init (LeveeQueue *self);
+
+extern void
+levee_queue_push (LeveeQueue *self, LeveeNode *node);
+
+extern LeveeNode *
+levee_queue_pop (LeveeQueue *self);
+
 #endif
 
@@ -0,0 +1,236 @@
+#include "pool.h"
+#include "list.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+typedef struct LeveePoolCache LeveePoolCache;
+
+typedef struct {
+	LeveePoolCache *owner; /* NULL for blocks too large to pool */
+	uint32_t cls;
+} __attribute__ ((aligned (16))) Header;
+
+typedef struct {
+	LeveeNode *free;   /* blocks freed on this thread */
+	uint32_t count;
+	LeveeList remote;  /* blocks freed on other threads */
+} Class;
+
+struct LeveePoolCache {
+	Class classes[LEVEE_POOL_CLASSES];
+	int64_t out;     /* blocks handed out and not yet back on a free list */
+	int64_t closing; /* blocks still out once the owning thread has exited */
+	LeveePoolStats stats;
+};
+
+/* marks the return list of a cache whose thread has exited */
+static LeveeNode closed;
+
+static __thread LeveePoolCache *cache;
+static pthread_key_t cache_key;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+static void cache_close (void *arg);
+
+static void
+cache_key_create (void)
+{
+	pthread_key_create (&cache_key, cache_close);
+}
+
+static LeveePoolCache *
+cache_open (void)
+{
+	pthread_once (&cache_once, cache_key_create);
+
+	LeveePoolCache *c = calloc (1, sizeof *c);
+	if (c == NULL) {
+		return NULL;
+	}
+	for (int i = 0; i < LEVEE_POOL_CLASSES; i++) {
+		levee_list_init (&c->classes[i].remote);
+	}
+	if (pthread_setspecific (cache_key, c) != 0) {
+		free (c);
+		return NULL;
+	}
+	cache = c;
+	return c;
+}
+
+static LeveeNode *
+swap_remote (LeveeList *list, LeveeNode *with)
+{
+	LeveeNode *tail;
+	do {
+		tail = list->tail;
+	} while (!__sync_bool_compare_and_swap (&list->tail, tail, with));
+	return tail;
+}
+
+static void
+release (LeveePoolCache *c, int64_t n)
+{
+	/* blocks freed remotely after the close count down from zero, so whichever
+	 * side settles the count last frees the cache */
+	if (__sync_add_and_fetch (&c->closing, n) == 0) {
+		free (c);
+	}
+}
+
+static void
+cache_close (void *arg)
+{
+	LeveePoolCache *c = arg;
+	int64_t out = c->out;
+
+	for (int i = 0; i < LEVEE_POOL_CLASSES; i++) {
+		LeveeNode *node = c->classes[i].free;
+		while (node != NULL) {
+			LeveeNode *next = node->next;
+			free ((Header *)node - 1);
+			node = next;
+		}
+
+		node = swap_remote (&c->classes[i].remote, &closed);
+		while (node != NULL) {
+			LeveeNode *next = node->next;
+			free ((Header *)node - 1);
+			node = next;
+			out--;
+		}
+	}
+
+	if (cache == c) {
+		cache = NULL;
+	}
+	release (c, out);
+}
+
+static void
+remote_free (LeveePoolCache *owner, Header *h)
+{
+	LeveeList *list = &owner->classes[h->cls].remote;
+	LeveeNode *node = (LeveeNode *)(h + 1), *next;
+
+	do {
+		next = list->tail;
+		if (next == &closed) {
+			free (h);
+			release (owner, -1);
+			return;
+		}
+		node->next = next;
+	} while (!__sync_bool_compare_and_swap (&list->tail, next, node));
+}
+
+void *
+levee_pool_alloc (size_t size)
+{
+	LeveePoolCache *c = cache;
+	Header *h;
+
+	if (size > LEVEE_POOL_MAX || (c == NULL && (c = cache_open ()) == NULL)) {
+		h = malloc (sizeof *h + size);
+		if (h == NULL) {
+			return NULL;
+		}
+		h->owner = NULL;
+		return h + 1;
+	}
+
+	uint32_t cls = size ? (size - 1) / LEVEE_POOL_QUANTUM : 0;
+	Class *slot = &c->classes[cls];
+
+	if (slot->free == NULL && slot->remote.tail != NULL) {
+		LeveeNode *node = swap_remote (&slot->remote, NULL);
+		while (node != NULL) {
+			LeveeNode *next = node->next;
+			if (slot->count < LEVEE_POOL_CACHE_MAX) {
+				node->next = slot->free;
+				slot->free = node;
+				slot->count++;
+			}
+			else {
+				free ((Header *)node - 1);
+			}
+			c->out--;
+			c->stats.remote++;
+			node = next;
+		}
+	}
+
+	if (slot->free != NULL) {
+		LeveeNode *node = slot->free;
+		slot->free = node->next;
+		slot->count--;
+		c->stats.hits++;
+		h = (Header *)node - 1;
+	}
+	else {
+		h = malloc (sizeof *h + (cls + 1) * LEVEE_POOL_QUANTUM);
+		if (h == NULL) {
+			return NULL;
+		}
+		h->owner = c;
+		h->cls = cls;
+		c->stats.misses++;
+	}
+
+	c->out++;
+	return h + 1;
+}
+
+void
+levee_pool_free (void *ptr)
+{
+	if (ptr == NULL) {
+		return;
+	}
+
+	Header *h = (Header *)ptr - 1;
+	LeveePoolCache *c = h->owner;
+
+	if (c == NULL) {
+		free (h);
+		return;
+	}
+	if (c != cache) {
+		remote_free (c, h);
+		return;
+	}
+
+	Class *slot = &c->classes[h->cls];
+	c->out--;
+	c->stats.frees++;
+	if (slot->count >= LEVEE_POOL_CACHE_MAX) {
+		free (h);
+		return;
+	}
+
+	LeveeNode *node = ptr;
+	node->next = slot->free;
+	slot->free = node;
+	slot->count++;
+}
+
+void
+levee_pool_stats (LeveePoolStats *stats)
+{
+	assert (stats != NULL);
+
+	LeveePoolCache *c = cache;
+	if (c == NULL) {
+		memset (stats, 0, sizeof *stats);
+		return;
+	}
+
+	*stats = c->stats;
+	stats->cached = 0;
+	for (int i = 0; i < LEVEE_POOL_CLASSES; i++) {
+		stats->cached += c->classes[i].count;
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef LEVEE_POOL_H
+#define LEVEE_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A per-thread free list allocator for small fixed size objects such as heap
+ * items and channel nodes. Each thread keeps its own free lists, one per 16
+ * byte size class, so allocating and freeing on the same thread takes no
+ * locks. A block freed on a different thread is pushed on to a lock-free
+ * return list of the thread that allocated it, which that thread reclaims the
+ * next time its free list runs dry.
+ */
+
+#define LEVEE_POOL_QUANTUM 16
+#define LEVEE_POOL_CLASSES 8
+#define LEVEE_POOL_MAX (LEVEE_POOL_QUANTUM * LEVEE_POOL_CLASSES)
+#define LEVEE_POOL_CACHE_MAX 4096
+
+typedef struct {
+	uint64_t hits;   /* allocations served from a free list */
+	uint64_t misses; /* allocations that fell through to malloc */
+	uint64_t frees;  /* blocks freed back on to the allocating thread */
+	uint64_t remote; /* blocks reclaimed after being freed by other threads */
+	uint64_t cached; /* blocks currently held on this thread's free lists */
+} LeveePoolStats;
+
+extern void *
+levee_pool_alloc (size_t size);
+
+extern void
+levee_pool_free (void *ptr);
+
+extern void
+levee_pool_stats (LeveePoolStats *stats);
+
+#endif
@@ -0,0 +1,453 @@
+#include "uring.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef LEVEE_URING
+
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <linux/io_uring.h>
+
+/* user_data for the poll on the epoll fd, and for poll removals */
+#define EPOLL_TAG  (1ULL << 63)
+#define REMOVE_TAG (1ULL << 62)
+#define GEN_MASK   0x3fffffffU
+
+#define DATA(fd, gen) ((uint64_t)(uint32_t)(fd) | ((uint64_t)(gen) << 32))
+
+/* io_uring_enter returns once all requests are submitted, so anything needed
+ * beyond this is only used with multishot polls and timed waits */
+#define FEATURES (IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS)
+
+typedef struct {
+	uint32_t mask; /* poll events, 0 when the fd isn't registered */
+	uint32_t gen;  /* bumped on unregister so stale completions can be told apart */
+} Slot;
+
+struct LeveeUring {
+	int fd;
+	int epfd;
+	int epoll_pending;
+	uint32_t queued;
+
+	unsigned *sq_head, *sq_tail, *sq_array;
+	unsigned sq_mask, sq_entries;
+	struct io_uring_sqe *sqes;
+
+	unsigned *cq_head, *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size, sqes_size;
+
+	Slot *slots;
+	uint32_t nslots;
+
+	LeveeUringStats stats;
+};
+
+static int enter (LeveeUring *, unsigned submit, unsigned min, unsigned flags,
+		void *arg, size_t argsz);
+static struct io_uring_sqe *get_sqe (LeveeUring *);
+static int arm (LeveeUring *, int fd, uint32_t mask, uint64_t data);
+static int drain_epoll (LeveeUring *, struct epoll_event *ev, int n, int max);
+
+LeveeUring *
+levee_uring_create (uint32_t entries, int epfd)
+{
+	struct io_uring_params p;
+	memset (&p, 0, sizeof p);
+
+	int fd = syscall (__NR_io_uring_setup, entries, &p);
+	if (fd < 0) {
+		return NULL;
+	}
+	if ((p.features & FEATURES) != FEATURES) {
+		close (fd);
+		errno = ENOSYS;
+		return NULL;
+	}
+
+	LeveeUring *self = calloc (1, sizeof *self);
+	if (self == NULL) {
+		close (fd);
+		return NULL;
+	}
+
+	self->fd = fd;
+	self->epfd = epfd;
+	self->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+	self->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+	self->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (self->cq_ring_size > self->sq_ring_size) {
+			self->sq_ring_size = self->cq_ring_size;
+		}
+		self->cq_ring_size = 0;
+	}
+
+	self->sq_ring = mmap (NULL, self->sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (self->sq_ring == MAP_FAILED) {
+		goto error;
+	}
+
+	if (self->cq_ring_size > 0) {
+		self->cq_ring = mmap (NULL, self->cq_ring_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (self->cq_ring == MAP_FAILED) {
+			goto error;
+		}
+	}
+	else {
+		self->cq_ring = self->sq_ring;
+	}
+
+	self->sqes = mmap (NULL, self->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (self->sqes == MAP_FAILED) {
+		goto error;
+	}
+
+	uint8_t *sq = self->sq_ring, *cq = self->cq_ring;
+	self->sq_head = (unsigned *)(sq + p.sq_off.head);
+	self->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	self->sq_array = (unsigned *)(sq + p.sq_off.array);
+	self->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+	self->sq_entries = *(unsigned *)(sq + p.sq_off.ring_entries);
+	self->cq_head = (unsigned *)(cq + p.cq_off.head);
+	self->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	self->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+	self->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	/* sqes are always used in ring order */
+	for (unsigned i = 0; i < self->sq_entries; i++) {
+		self->sq_array[i] = i;
+	}
+
+	if (epfd >= 0 && arm (self, epfd, EPOLLIN, EPOLL_TAG) < 0) {
+		goto error;
+	}
+
+	return self;
+
+error:
+	{
+		int err = errno;
+		levee_uring_destroy (self);
+		errno = err;
+	}
+	return NULL;
+}
+
+void
+levee_uring_destroy (LeveeUring *self)
+{
+	if (self == NULL) {
+		return;
+	}
+
+	/* closing the ring cancels its polls, dropping their file references */
+	if (self->sqes != NULL && self->sqes != MAP_FAILED) {
+		munmap (self->sqes, self->sqes_size);
+	}
+	if (self->cq_ring != NULL && self->cq_ring != MAP_FAILED &&
+			self->cq_ring != self->sq_ring) {
+		munmap (self->cq_ring, self->cq_ring_size);
+	}
+	if (self->sq_ring != NULL && self->sq_ring != MAP_FAILED) {
+		munmap (self->sq_ring, self->sq_ring_size);
+	}
+	close (self->fd);
+	free (self->slots);
+	free (self);
+}
+
+int
+levee_uring_register (LeveeUring *self, int fd, uint32_t events)
+{
+	assert (self != NULL);
+
+	if (fd < 0) {
+		return -EBADF;
+	}
+
+	if ((uint32_t)fd >= self->nslots) {
+		uint32_t n = self->nslots ? self->nslots : 64;
+		while (n <= (uint32_t)fd) {
+			n *= 2;
+		}
+		Slot *slots = realloc (self->slots, n * sizeof *slots);
+		if (slots == NULL) {
+			return -errno;
+		}
+		memset (slots + self->nslots, 0, (n - self->nslots) * sizeof *slots);
+		self->slots = slots;
+		self->nslots = n;
+	}
+
+	Slot *slot = &self->slots[fd];
+	if (slot->mask != 0) {
+		return -EEXIST;
+	}
+
+	int rc = arm (self, fd, events, DATA (fd, slot->gen));
+	if (rc == 0) {
+		slot->mask = events;
+	}
+	return rc;
+}
+
+int
+levee_uring_unregister (LeveeUring *self, int fd)
+{
+	assert (self != NULL);
+
+	if (fd < 0 || (uint32_t)fd >= self->nslots || self->slots[fd].mask == 0) {
+		return 0;
+	}
+
+	Slot *slot = &self->slots[fd];
+	struct io_uring_sqe *sqe = get_sqe (self);
+	if (sqe == NULL) {
+		return -EBUSY;
+	}
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = DATA (fd, slot->gen);
+	sqe->user_data = REMOVE_TAG;
+
+	slot->mask = 0;
+	slot->gen = (slot->gen + 1) & GEN_MASK;
+	return 0;
+}
+
+int
+levee_uring_wait (LeveeUring *self, int64_t ms, struct epoll_event *ev, int max)
+{
+	assert (self != NULL);
+	assert (ev != NULL && max > 0);
+
+	int n = 0;
+	int rc = 0;
+
+	if (self->epoll_pending) {
+		n = drain_epoll (self, ev, n, max);
+	}
+
+	/* block only if there's nothing to hand back yet */
+	unsigned min = (n == 0 && ms != 0) ? 1 : 0;
+
+	if (min && ms > 0) {
+		struct __kernel_timespec ts = {
+			.tv_sec = ms / 1000,
+			.tv_nsec = (ms % 1000) * 1000000
+		};
+		struct io_uring_getevents_arg arg = {
+			.ts = (uint64_t)(uintptr_t)&ts
+		};
+		rc = enter (self, self->queued, 1,
+				IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+	}
+	else if (min || self->queued > 0) {
+		rc = enter (self, self->queued, min,
+				min ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	}
+
+	if (rc < 0 && rc != -ETIME && rc != -EINTR && rc != -EBUSY && rc != -EAGAIN) {
+		return rc;
+	}
+
+	unsigned head = *self->cq_head;
+	unsigned tail = __atomic_load_n (self->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail && n < max) {
+		struct io_uring_cqe *cqe = &self->cqes[head & self->cq_mask];
+		uint64_t data = cqe->user_data;
+		int32_t res = cqe->res;
+		int more = cqe->flags & IORING_CQE_F_MORE;
+		head++;
+		self->stats.cqes++;
+
+		if (data == REMOVE_TAG) {
+			continue;
+		}
+
+		if (data == EPOLL_TAG) {
+			if (!more) {
+				arm (self, self->epfd, EPOLLIN, EPOLL_TAG);
+			}
+			self->epoll_pending = 1;
+			continue;
+		}
+
+		uint32_t fd = (uint32_t)data;
+		if (fd >= self->nslots || self->slots[fd].mask == 0 ||
+				self->slots[fd].gen != (uint32_t)(data >> 32)) {
+			self->stats.stale++;
+			continue;
+		}
+
+		if (res < 0) {
+			/* the poll failed outright; report it and leave the fd disarmed */
+			self->slots[fd].mask = 0;
+			self->slots[fd].gen = (self->slots[fd].gen + 1) & GEN_MASK;
+			ev[n].events = EPOLLERR;
+		}
+		else {
+			/* a multishot poll can end early, e.g. if the CQ overflowed */
+			if (!more) {
+				arm (self, fd, self->slots[fd].mask, data);
+			}
+			ev[n].events = (uint32_t)res;
+		}
+		ev[n].data.u64 = fd;
+		n++;
+	}
+
+	__atomic_store_n (self->cq_head, head, __ATOMIC_RELEASE);
+
+	if (self->epoll_pending && n < max) {
+		n = drain_epoll (self, ev, n, max);
+	}
+
+	return n;
+}
+
+void
+levee_uring_stats (const LeveeUring *self, LeveeUringStats *stats)
+{
+	assert (self != NULL);
+	assert (stats != NULL);
+
+	*stats = self->stats;
+}
+
+static int
+enter (LeveeUring *self, unsigned submit, unsigned min, unsigned flags,
+		void *arg, size_t argsz)
+{
+	self->stats.enters++;
+	int rc = syscall (__NR_io_uring_enter, self->fd, submit, min, flags, arg, argsz);
+	if (rc < 0) {
+		return -errno;
+	}
+	/* the return value is the number of sqes consumed */
+	self->queued -= (uint32_t)rc < self->queued ? (uint32_t)rc : self->queued;
+	self->stats.sqes += rc;
+	return rc;
+}
+
+static struct io_uring_sqe *
+get_sqe (LeveeUring *self)
+{
+	unsigned tail = *self->sq_tail;
+
+	if (tail - __atomic_load_n (self->sq_head, __ATOMIC_ACQUIRE) >= self->sq_entries) {
+		/* the ring is full, so submit what's queued without waiting */
+		enter (self, self->queued, 0, 0, NULL, 0);
+		if (tail - __atomic_load_n (self->sq_head, __ATOMIC_ACQUIRE) >= self->sq_entries) {
+			return NULL;
+		}
+	}
+
+	struct io_uring_sqe *sqe = &self->sqes[tail & self->sq_mask];
+	memset (sqe, 0, sizeof *sqe);
+	__atomic_store_n (self->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	self->queued++;
+	return sqe;
+}
+
+static int
+arm (LeveeUring *self, int fd, uint32_t mask, uint64_t data)
+{
+	struct io_uring_sqe *sqe = get_sqe (self);
+	if (sqe == NULL) {
+		return -EBUSY;
+	}
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->poll32_events = mask;
+	sqe->user_data = data;
+	self->stats.polls++;
+	return 0;
+}
+
+static int
+drain_epoll (LeveeUring *self, struct epoll_event *ev, int n, int max)
+{
+	int k = epoll_wait (self->epfd, ev + n, max - n, 0);
+	if (k < 0) {
+		k = 0;
+	}
+	/* a full batch may have left events behind */
+	self->epoll_pending = k == max - n;
+	return n + k;
+}
+
+#else
+
+struct LeveeUring {
+	int unused;
+};
+
+LeveeUring *
+levee_uring_create (uint32_t entries, int epfd)
+{
+	(void)entries;
+	(void)epfd;
+	errno = ENOSYS;
+	return NULL;
+}
+
+void
+levee_uring_destroy (LeveeUring *self)
+{
+	free (self);
+}
+
+int
+levee_uring_register (LeveeUring *self, int fd, uint32_t events)
+{
+	(void)self;
+	(void)fd;
+	(void)events;
+	return -ENOSYS;
+}
+
+int
+levee_uring_unregister (LeveeUring *self, int fd)
+{
+	(void)self;
+	(void)fd;
+	return -ENOSYS;
+}
+
+int
+levee_uring_wait (LeveeUring *self, int64_t ms, struct epoll_event *ev, int max)
+{
+	(void)self;
+	(void)ms;
+	(void)ev;
+	(void)max;
+	return -ENOSYS;
+}
+
+void
+levee_uring_stats (const LeveeUring *self, LeveeUringStats *stats)
+{
+	(void)self;
+	(void)stats;
+}
+
+#endif
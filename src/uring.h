@@ -0,0 +1,55 @@
+#ifndef LEVEE_URING_H
+#define LEVEE_URING_H
+
+#include <stdint.h>
+
+/*
+ * An io_uring backed readiness poller. Each registered fd gets a single
+ * multishot poll request, so arming and disarming fds are queued as SQEs and
+ * submitted together with the wait for completions in one io_uring_enter per
+ * pump. Completions are handed back as epoll_events, so a hub can't tell this
+ * poller from the epoll one.
+ *
+ * An epoll fd is polled through the ring as well; channels and signalfds keep
+ * registering on that with epoll_ctl and their events are merged in.
+ *
+ * levee_uring_create fails with ENOSYS where io_uring or the features it needs
+ * (multishot poll and timed waits, Linux 5.13) aren't available.
+ */
+
+#if defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  define LEVEE_URING
+# endif
+#endif
+
+typedef struct LeveeUring LeveeUring;
+struct epoll_event;
+
+typedef struct {
+	uint64_t enters;  /* io_uring_enter calls */
+	uint64_t sqes;    /* requests submitted */
+	uint64_t cqes;    /* completions reaped */
+	uint64_t polls;   /* multishot polls armed, including re-arms */
+	uint64_t stale;   /* completions for fds since unregistered */
+} LeveeUringStats;
+
+extern LeveeUring *
+levee_uring_create (uint32_t entries, int epfd);
+
+extern void
+levee_uring_destroy (LeveeUring *self);
+
+extern int
+levee_uring_register (LeveeUring *self, int fd, uint32_t events);
+
+extern int
+levee_uring_unregister (LeveeUring *self, int fd);
+
+extern int
+levee_uring_wait (LeveeUring *self, int64_t ms, struct epoll_event *ev, int max);
+
+extern void
+levee_uring_stats (const LeveeUring *self, LeveeUringStats *stats);
+
+#endif
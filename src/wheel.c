@@ -0,0 +1,274 @@
+#include "wheel.h"
+#include "pool.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+#define SLOT_MASK   (LEVEE_WHEEL_SLOTS - 1)
+#define SPAN(l)     ((int64_t)1 << (LEVEE_WHEEL_BITS * (l)))
+#define RANGE       SPAN (LEVEE_WHEEL_LEVELS)
+#define FIRST(s)    (&(s)->slots[0][0])
+#define LAST(s)     (&(s)->slots[LEVEE_WHEEL_LEVELS-1][SLOT_MASK])
+
+static void link_init (LeveeWheelLink *head);
+static void link_append (LeveeWheelLink *head, LeveeWheelLink *link);
+static void link_remove (LeveeWheel *, LeveeWheelLink *link);
+static void place (LeveeWheel *, LeveeWheelItem *item);
+static void cascade (LeveeWheel *, int level, uint32_t slot);
+static int64_t level_next (const LeveeWheel *, int level);
+static int64_t pending_next (const LeveeWheel *);
+static void advance (LeveeWheel *, int64_t target);
+
+LeveeWheel *
+levee_wheel_create (int64_t now)
+{
+	LeveeWheel *self = calloc (1, sizeof (struct LeveeWheel));
+	if (self == NULL) {
+		return NULL;
+	}
+
+	for (int l = 0; l < LEVEE_WHEEL_LEVELS; l++) {
+		for (int s = 0; s < LEVEE_WHEEL_SLOTS; s++) {
+			link_init (&self->slots[l][s]);
+		}
+	}
+	link_init (&self->expired);
+	self->now = now;
+	return self;
+}
+
+void
+levee_wheel_destroy (LeveeWheel *self)
+{
+	if (self == NULL) {
+		return;
+	}
+
+	levee_wheel_clear (self);
+	free (self);
+}
+
+uint32_t
+levee_wheel_count (const LeveeWheel *self)
+{
+	assert (self != NULL);
+
+	return self->count;
+}
+
+LeveeWheelItem *
+levee_wheel_add (LeveeWheel *self, int64_t expires)
+{
+	assert (self != NULL);
+
+	LeveeWheelItem *item = levee_pool_alloc (sizeof *item);
+	if (item == NULL) {
+		return NULL;
+	}
+
+	item->wheel = self;
+	item->expires = expires;
+	place (self, item);
+	self->count++;
+	return item;
+}
+
+void
+levee_wheel_remove (LeveeWheel *self, LeveeWheelItem *item)
+{
+	assert (self != NULL);
+	assert (item != NULL && item->wheel == self);
+
+	link_remove (self, &item->link);
+	self->count--;
+	levee_pool_free (item);
+}
+
+int64_t
+levee_wheel_next (const LeveeWheel *self)
+{
+	assert (self != NULL);
+
+	if (self->count == 0) {
+		return -1;
+	}
+	if (self->expired.next != &self->expired) {
+		return self->now;
+	}
+	return pending_next (self);
+}
+
+LeveeWheelItem *
+levee_wheel_expire (LeveeWheel *self, int64_t now)
+{
+	assert (self != NULL);
+
+	advance (self, now);
+	if (self->expired.next == &self->expired) {
+		return NULL;
+	}
+	return (LeveeWheelItem *)self->expired.next;
+}
+
+void
+levee_wheel_clear (LeveeWheel *self)
+{
+	assert (self != NULL);
+
+	for (LeveeWheelLink *head = FIRST (self); head <= LAST (self); head++) {
+		while (head->next != head) {
+			levee_wheel_remove (self, (LeveeWheelItem *)head->next);
+		}
+	}
+	while (self->expired.next != &self->expired) {
+		levee_wheel_remove (self, (LeveeWheelItem *)self->expired.next);
+	}
+	assert (self->count == 0);
+}
+
+static void
+link_init (LeveeWheelLink *head)
+{
+	head->next = head->prev = head;
+}
+
+static void
+link_append (LeveeWheelLink *head, LeveeWheelLink *link)
+{
+	link->prev = head->prev;
+	link->next = head;
+	head->prev->next = link;
+	head->prev = link;
+}
+
+static void
+link_remove (LeveeWheel *self, LeveeWheelLink *link)
+{
+	LeveeWheelLink *next = link->next, *prev = link->prev;
+	next->prev = prev;
+	prev->next = next;
+
+	/* the slot is now empty if both neighbours are its head */
+	if (next == prev && next >= FIRST (self) && next <= LAST (self)) {
+		uint32_t idx = next - FIRST (self);
+		self->occupied[idx / LEVEE_WHEEL_SLOTS] &= ~(1ULL << (idx & SLOT_MASK));
+	}
+}
+
+static void
+place (LeveeWheel *self, LeveeWheelItem *item)
+{
+	int64_t delta = item->expires - self->now;
+	int64_t at = item->expires;
+	int level = 0;
+	uint32_t slot;
+
+	if (delta <= 0) {
+		link_append (&self->expired, &item->link);
+		return;
+	}
+
+	/* timers beyond the top level are parked in its furthest slot and placed
+	 * again once that slot cascades */
+	if (delta >= RANGE) {
+		delta = RANGE - 1;
+		at = self->now + delta;
+	}
+
+	while (delta >= SPAN (level + 1)) {
+		level++;
+	}
+
+	slot = (at >> (LEVEE_WHEEL_BITS * level)) & SLOT_MASK;
+	link_append (&self->slots[level][slot], &item->link);
+	self->occupied[level] |= 1ULL << slot;
+}
+
+static void
+cascade (LeveeWheel *self, int level, uint32_t slot)
+{
+	LeveeWheelLink *head = &self->slots[level][slot];
+	LeveeWheelLink pending;
+
+	if (head->next == head) {
+		return;
+	}
+
+	/* detach the whole slot before placing its timers again, as they may land
+	 * back on this level */
+	pending.next = head->next;
+	pending.prev = head->prev;
+	pending.next->prev = &pending;
+	pending.prev->next = &pending;
+	link_init (head);
+	self->occupied[level] &= ~(1ULL << slot);
+
+	while (pending.next != &pending) {
+		LeveeWheelLink *link = pending.next;
+		pending.next = link->next;
+		link->next->prev = &pending;
+		place (self, (LeveeWheelItem *)link);
+	}
+}
+
+/*
+ * Returns the next tick at which an occupied slot on the level is due: the
+ * timer's expiry on level 0, or the time the slot cascades on the levels above.
+ */
+static int64_t
+level_next (const LeveeWheel *self, int level)
+{
+	uint64_t mask = self->occupied[level];
+	if (mask == 0) {
+		return INT64_MAX;
+	}
+
+	int shift = LEVEE_WHEEL_BITS * level;
+	uint32_t from = ((self->now >> shift) + 1) & SLOT_MASK;
+
+	/* rotate so the search starts at the slot after the current one */
+	uint64_t rot = from ? (mask >> from) | (mask << (LEVEE_WHEEL_SLOTS - from)) : mask;
+	uint32_t slot = (from + __builtin_ctzll (rot)) & SLOT_MASK;
+
+	int64_t span = SPAN (level + 1);
+	int64_t t = (self->now & ~(span - 1)) + ((int64_t)slot << shift);
+	if (t <= self->now) {
+		t += span;
+	}
+	return t;
+}
+
+static int64_t
+pending_next (const LeveeWheel *self)
+{
+	int64_t next = INT64_MAX;
+	for (int l = 0; l < LEVEE_WHEEL_LEVELS; l++) {
+		int64_t t = level_next (self, l);
+		if (t < next) {
+			next = t;
+		}
+	}
+	return next;
+}
+
+static void
+advance (LeveeWheel *self, int64_t target)
+{
+	while (self->now < target) {
+		int64_t t = pending_next (self);
+		if (t > target) {
+			self->now = target;
+			return;
+		}
+
+		self->now = t;
+
+		/* cascade every level whose slot boundary we've reached, top down */
+		for (int l = LEVEE_WHEEL_LEVELS - 1; l > 0; l--) {
+			if ((t & (SPAN (l) - 1)) == 0) {
+				cascade (self, l, (t >> (LEVEE_WHEEL_BITS * l)) & SLOT_MASK);
+			}
+		}
+		cascade (self, 0, t & SLOT_MASK);
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef LEVEE_WHEEL_H
+#define LEVEE_WHEEL_H
+
+#include <stdint.h>
+
+/*
+ * A hierarchical timer wheel. Timers are bucketed by how far away they are
+ * into LEVEE_WHEEL_LEVELS wheels of LEVEE_WHEEL_SLOTS slots each, where a slot
+ * on level n spans SLOTS^n ticks. Adding and removing a timer is O(1); as time
+ * advances, slots on the upper levels are cascaded down into the lower ones
+ * until a timer reaches the expired list.
+ */
+
+#define LEVEE_WHEEL_BITS 6
+#define LEVEE_WHEEL_SLOTS (1 << LEVEE_WHEEL_BITS)
+#define LEVEE_WHEEL_LEVELS 5
+
+typedef struct LeveeWheel LeveeWheel;
+typedef struct LeveeWheelLink LeveeWheelLink;
+typedef struct LeveeWheelItem LeveeWheelItem;
+
+struct LeveeWheelLink {
+	LeveeWheelLink *next, *prev;
+};
+
+struct LeveeWheelItem {
+	LeveeWheelLink link;
+	LeveeWheel *wheel;
+	int64_t expires;
+};
+
+struct LeveeWheel {
+	int64_t now;
+	uint32_t count;
+	uint64_t occupied[LEVEE_WHEEL_LEVELS];
+	LeveeWheelLink slots[LEVEE_WHEEL_LEVELS][LEVEE_WHEEL_SLOTS];
+	LeveeWheelLink expired;
+};
+
+extern LeveeWheel *
+levee_wheel_create (int64_t now);
+
+extern void
+levee_wheel_destroy (LeveeWheel *self);
+
+extern uint32_t
+levee_wheel_count (const LeveeWheel *self);
+
+extern LeveeWheelItem *
+levee_wheel_add (LeveeWheel *self, int64_t expires);
+
+extern void
+levee_wheel_remove (LeveeWheel *self, LeveeWheelItem *item);
+
+extern int64_t
+levee_wheel_next (const LeveeWheel *self);
+
+extern LeveeWheelItem *
+levee_wheel_expire (LeveeWheel *self, int64_t now);
+
+extern void
+levee_wheel_clear (LeveeWheel *self);
+
+#endif
@@ -29,4 +29,74 @@ return {
 		poller:unregister(r, true)
 		poller:unregister(w, false, true)
 	end,
+	test_batch = function()
+		local poller = _.poller()
+		poller:batch(2, 8)
+
+		local fds = {}
+		for i = 1, 4 do
+			local r, w = _.pipe()
+			table.insert(fds, r)
+			table.insert(fds, w)
+			poller:register(r, true)
+			poller:register(w, false, true)
+		end
+		-- make all 8 fds ready
+		for i = 1, 4 do _.write(fds[i * 2], "x") end
+
+		-- full batches double the batch for the next poll
+		local err, events, n = poller:poll(0)
+		assert.equal(n, 2)
+		local err, events, n = poller:poll(0)
+		assert.equal(n, 4)
+		local err, events, n = poller:poll(0)
+		assert.equal(n, 2)
+		assert.equal(poller:stats().size, 8)
+
+		-- and staying idle shrinks it again
+		for i = 1, 17 do poller:poll(0) end
+		local stats = poller:stats()
+		assert.equal(stats.size, 4)
+		assert.equal(stats.wakeups, 3)
+		assert.equal(stats.events, 8)
+		assert.equal(stats.full, 2)
+		assert.equal(stats.mean, 8 / 3)
+
+		for __, no in ipairs(fds) do _.close(no) end
+	end,
+
+	test_uring = function()
+		local r, w = _.pipe()
+		local poller = _.poller("uring")
+		if poller.backend ~= "uring" then return "SKIP" end
+
+		poller:register(r, true)
+		poller:register(w, false, true)
+
+		-- registrations are submitted with the first wait
+		local err, events, n = poller:poll()
+		assert.equal(n, 1)
+		assert.same({w, false, false, false, true, false}, {events[0]:value()})
+
+		local err, events, n = poller:poll(poller:reltime(100))
+		assert.equal(n, 0)
+
+		_.write(w, "foo")
+		local err, events, n = poller:poll()
+		assert.equal(n, 1)
+		assert.same({r, false, false, true, false, false}, {events[0]:value()})
+
+		-- the ring holds a reference to w until it's unregistered
+		poller:unregister(w)
+		_.close(w)
+		local err, events, n = poller:poll()
+		assert.equal(n, 1)
+		assert.same({r, false, false, true, false, true}, {events[0]:value()})
+
+		poller:unregister(r)
+		_.close(r)
+		local stats = poller:stats()
+		assert.equal(stats.armed, 3)
+		assert(stats.enters <= 5)
+	end,
 }
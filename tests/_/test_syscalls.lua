@@ -250,4 +250,10 @@ return {
 
 		assert.equal(_.getservbyname("xxx"), nil)
 	end,
+
+	test_set_affinity_range = function()
+		if ffi.os:lower() ~= "linux" then return "SKIP" end
+		assert.equal(_.set_affinity(-1), errors.system.EINVAL)
+		assert.equal(_.set_affinity(1024 * 1024), errors.system.EINVAL)
+	end,
 }
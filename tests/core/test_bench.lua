@@ -0,0 +1,320 @@
+local levee = require("levee")
+local _ = levee._
+local d = levee.d
+
+
+return {
+	-- benchmarks only run when LEVEE_BENCH is set in the environment
+	skipif = function() return not os.getenv("LEVEE_BENCH") end,
+
+	test_resume = function()
+		-- the ready queue the hub used before d.Ring: a table per entry
+		local function FifoReady()
+			local fifo = d.Fifo()
+			return setmetatable({}, {
+				__len = function() return #fifo end,
+				__index = {
+					push = function(self, co, err, sender, value)
+						fifo:push({co, err, sender, value})
+					end,
+					pop = function(self) return unpack(fifo:pop()) end, }, })
+		end
+
+		-- each tick resumes 100 green threads plus the main thread
+		local function bench(name, h)
+			local stop = false
+			for i = 1, 100 do
+				h:spawn(function() while not stop do h:continue() end end)
+			end
+			print()
+			_.time.benchmark(name, 10000, function() h:continue() end)
+			stop = true
+			h:continue()
+		end
+
+		local h = levee.Hub()
+		h.ready = FifoReady()
+		bench("tick x101 resumes (d.Fifo)", h)
+
+		bench("tick x101 resumes (d.Ring)", levee.Hub())
+	end,
+
+	test_timers = function()
+		-- the common timeout pattern: most timers are cancelled before they fire.
+		-- 10k idle timers stand in for the timeouts of other connections
+		local function bench(name, scheduled)
+			for i = 1, 10000 do scheduled:push(1e9 + i, i) end
+			local items = {}
+			local now = 0
+			print()
+			_.time.benchmark(name, 100000, function()
+				now = now + 1
+				for i = 1, 10 do
+					items[i] = scheduled:push(now + 10 * i, i)
+				end
+				for i = 1, 9 do items[i]:remove() end
+				while scheduled:expire(now) do end
+			end)
+		end
+
+		bench("10 add / 9 cancel / expire (d.Heap)", d.Heap())
+		bench("10 add / 9 cancel / expire (d.Wheel)", d.Wheel(0))
+
+		-- pause with a timeout, resumed before the timeout fires
+		local function pause(name, h)
+			local co
+			h:spawn(function()
+				co = coroutine.running()
+				while true do h:pause(1000) end
+			end)
+			print()
+			_.time.benchmark(name, 100000, function() h:resume(co); h:continue() end)
+		end
+
+		pause("pause(1000) / resume (d.Heap)", levee.Hub())
+		pause("pause(1000) / resume (d.Wheel)", levee.Hub({timers="wheel"}))
+	end,
+
+	test_channel = function()
+		local h = levee.Hub()
+		local chan = h.thread:channel()
+
+		local function report(name, n, timer, notifies)
+			print(("%s: %d msgs, %.0f msgs/sec, %.3f notifies/msg"):format(
+				name, n, n / timer:seconds(), notifies / n))
+		end
+
+		print()
+
+		-- ping-pong: a single message in flight between two threads
+		local child = h.thread:spawn(function(h)
+			while true do
+				local err, n = h.parent:recv()
+				if err then break end
+				h.parent:send(n)
+			end
+		end)
+
+		local n = 20000
+		local notifies = chan:stats().notifies
+		local timer = _.time.Timer()
+		for i = 1, n do
+			child:send(i)
+			assert(child:recv() == nil)
+		end
+		timer:finish()
+		report("ping-pong", n, timer, chan:stats().notifies - notifies)
+		child.sender:close()
+
+		-- fan-in: producer threads contending to send to a single consumer
+		for __, producers in ipairs({1, 2, 4, 8, 16}) do
+			local m = math.floor(200000 / producers)
+			local children = {}
+			notifies = chan:stats().notifies
+			timer = _.time.Timer()
+			for i = 1, producers do
+				children[i] = h.thread:spawn(function(h, m)
+					for i = 1, m do h.parent:send(i) end
+				end, m)
+			end
+			for i = 1, producers do
+				for j = 1, m do assert(children[i]:recv() == nil) end
+			end
+			timer:finish()
+			report(("fan-in x%d"):format(producers),
+				producers * m, timer, chan:stats().notifies - notifies)
+		end
+	end,
+	test_buffered = function()
+		-- responses/sec when a response is written as a status line, headers and
+		-- a body over loopback, with and without buffered writes
+		local status = "HTTP/1.1 200 OK\r\n"
+		local headers = "Content-Type: text/plain\r\nContent-Length: 4\r\n\r\n"
+		local body = "pong"
+		local len = #status + #headers + #body
+
+		local function bench(name, buffered, n)
+			local h = levee.Hub()
+			local err, serve = h.stream:listen()
+			local err, addr = serve:addr()
+			local err, c = h.stream:dial(addr:port())
+			local err, s = serve:recv()
+			if buffered then s:buffered() end
+
+			h:spawn(function()
+				local buf = d.Buffer(4096)
+				while true do
+					local err = s:readinto(buf, 1)
+					if err then break end
+					buf:trim()
+					s:write(status)
+					s:write(headers)
+					s:write(body)
+				end
+			end)
+
+			local buf = d.Buffer(4096)
+			local timer = _.time.Timer()
+			for i = 1, n do
+				c:write("x")
+				c:readinto(buf, len)
+				buf:trim()
+			end
+			timer:finish()
+
+			local syscalls = buffered and s:wstats().syscalls / n or 3
+			print(("\n%s: %.0f responses/sec, %.2f write syscalls/response"):format(
+				name, n / timer:seconds(), syscalls))
+			c:close()
+			s:close()
+			serve:close()
+		end
+
+		bench("unbuffered", false, 20000)
+		bench("buffered", true, 20000)
+	end,
+
+	test_pipelined = function()
+		-- messages/sec decoding pipelined HTTP requests and a msgpack stream
+		-- read off a pipe, into a Buffer and into a Mirror
+		local HTTP = require("levee.p.http.0_4")
+		local request = "" ..
+			"GET /some/path HTTP/1.1\r\n" ..
+			"Host: localhost\r\n" ..
+			"User-Agent: levee\r\n" ..
+			"Accept: */*\r\n" ..
+			"\r\n"
+		local message = levee.p.msgpack.encode(
+			{id=1, method="get", params={"foo", "bar"}}):peek()
+
+		local function bench(name, mirror, payload, n, decode)
+			local h = levee.Hub({io={mirror=mirror}})
+			if mirror and not h.io.mirror then
+				print(("\n%s: unavailable"):format(name))
+				return
+			end
+
+			local r, w = h.io:pipe()
+			h:spawn(function()
+				local batch = payload:rep(64)
+				for _ = 1, n / 64 do w:write(batch) end
+				w:close()
+			end)
+
+			local s = r:stream()
+			local timer = _.time.Timer()
+			for _ = 1, n do assert(not decode(s)) end
+			timer:finish()
+
+			print(("\n%s: %.0f messages/sec"):format(name, n / timer:seconds()))
+			r:close()
+		end
+
+		local parser = HTTP.Parser()
+		local function http(s) return (HTTP.decode_request(parser, s)) end
+		local function msgpack(s) return (s:msgpack()) end
+
+		bench("http buffer", false, request, 640000, http)
+		bench("http mirror", true, request, 640000, http)
+		bench("msgpack buffer", false, message, 640000, msgpack)
+		bench("msgpack mirror", true, message, 640000, msgpack)
+	end,
+
+	test_http_encode = function()
+		-- bytes allocated per response encoded, against concatenating each
+		-- header line as encode_headers used to. each response has its own
+		-- request id, as a concatenated line would be a new string each time
+		local HTTP = require("levee.p.http.0_4")
+		local Status = require("levee.p.http.status")
+
+		local concat = {
+			encode_response = function(buf, status, headers, body)
+				buf:push(tostring(Status(status)))
+				headers["Content-Length"] = tostring(#body)
+				for k, v in pairs(headers) do buf:push(k..": "..v.."\r\n") end
+				buf:push("\r\n")
+				buf:push(body)
+			end, }
+
+		local function bench(name, encoder, n)
+			local buf = d.Buffer(4096)
+			local headers = {
+				["Content-Type"] = "application/json",
+				["Cache-Control"] = "no-cache",
+				Date = "Sun, 18 Oct 2009 08:56:53 GMT", }
+			local body = '{"ok": true}'
+			local ids = {}
+			for i = 1, n do ids[i] = ("%08x"):format(i) end
+
+			collectgarbage()
+			collectgarbage("stop")
+			local before = collectgarbage("count")
+			local timer = _.time.Timer()
+			for i = 1, n do
+				headers["X-Request-Id"] = ids[i]
+				encoder.encode_response(buf, 200, headers, body)
+				buf:trim()
+			end
+			timer:finish()
+			local allocated = (collectgarbage("count") - before) * 1024
+			collectgarbage("restart")
+
+			print(("\n%s: %.0f responses/sec, %.1f bytes allocated/response"):format(
+				name, n / timer:seconds(), allocated / n))
+		end
+
+		bench("concat", concat, 200000)
+		bench("encode_response", HTTP, 200000)
+	end,
+
+	test_http_echo = function()
+		-- requests/sec for HTTP POSTs echoed back over loopback, with the client
+		-- and server sharing a hub, for each poller backend
+		local function bench(backend, conns, n)
+			local h = levee.Hub({poller=backend})
+			if h.poller.backend ~= backend then
+				print(("\n%s: unavailable"):format(backend))
+				return
+			end
+
+			local err, serve = h.http:listen()
+			local err, addr = serve:addr()
+			h:spawn(function()
+				for s in serve do
+					h:spawn(function()
+						for req in s do
+							req.response:send({
+								levee.HTTPStatus(200), {}, req.body:tostring()})
+						end
+					end)
+				end
+			end)
+
+			local sender, recver = h:pipe()
+			local timer = _.time.Timer()
+			for i = 1, conns do
+				h:spawn(function()
+					local err, c = h.http:connect(addr:port())
+					for j = 1, n do
+						local err, response = c:post("/echo", {data="ping"})
+						local err, response = response:recv()
+						assert(response.body:tostring() == "ping")
+					end
+					c:close()
+					sender:send(true)
+				end)
+			end
+			for i = 1, conns do recver:recv() end
+			timer:finish()
+
+			print(("\n%s x%d: %.0f requests/sec"):format(
+				backend, conns, conns * n / timer:seconds()))
+			serve:close()
+		end
+
+		for __, conns in ipairs({1, 16}) do
+			bench("epoll", conns, math.floor(20000 / conns))
+			bench("uring", conns, math.floor(20000 / conns))
+		end
+	end,
+}
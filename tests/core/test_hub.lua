@@ -158,6 +158,18 @@ return {
 		local rel = h.poller:reltime(abs)
 		assert.equal(100LL, rel)
 	end,
+
+	test_now = function()
+		local h = levee.Hub()
+		local now = h:now()
+		assert.equal(type(now), "number")
+		assert.equal(tonumber(h.poller:abstime(0)), now)
+		-- cached until the hub next polls
+		assert.equal(h:now(), now)
+		h:sleep(20)
+		assert(h:now() - now >= 20)
+		assert(math.abs(h:time() - os.time()) <= 1)
+	end,
 	
 	test_sleep = function()
 		local h = levee.Hub()
@@ -168,6 +180,52 @@ return {
 		assert(diff > 0.09 and diff < 0.11, diff)
 	end,
 
+	test_timers_wheel = function()
+		local h = levee.Hub({timers="wheel"})
+
+		local start = _.time.now()
+		h:sleep(100)
+		local diff = (_.time.now() - start):seconds()
+		assert(diff > 0.09 and diff < 0.11, diff)
+
+		local sender, recver = h:pipe()
+		h:spawn_later(10, function() sender:send("foo") end)
+		assert.same({recver:recv(1000)}, {nil, "foo"})
+		assert.equal(recver:recv(10), levee.errors.TIMEOUT)
+		assert.equal(#h.scheduled, 0)
+	end,
+
+	test_poller_uring = function()
+		local h = levee.Hub({poller="uring"})
+		-- falls back to epoll on kernels without io_uring
+		if h.poller.backend ~= "uring" then return "SKIP" end
+
+		local r, w = h.io:pipe()
+		w:write("foo")
+		assert.equal(r:reads(), "foo")
+
+		local sender, recver = h:pipe()
+		h:spawn_later(10, function() sender:send("bar") end)
+		assert.same({recver:recv(1000)}, {nil, "bar"})
+		assert.equal(recver:recv(10), levee.errors.TIMEOUT)
+
+		local now = h:now()
+		assert(now > 0)
+		h:sleep(20)
+		assert(h:now() - now >= 20)
+
+		local chan = h.thread:channel():bind()
+		local chan_sender = chan:create_sender()
+		chan_sender:send(123)
+		assert.same({chan:recv()}, {nil, 123})
+
+		-- the write end is only really closed once its poll is removed
+		w:close()
+		assert.equal(r:reads(), nil)
+
+		assert(h.poller:stats().enters > 0)
+	end,
+
 	test_error = function()
 		-- investigate the behavior of error reporting when a coroutine errors
 		-- skipped as this would trigger a FAIL otherwise
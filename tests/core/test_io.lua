@@ -319,6 +319,199 @@ return {
 			assert(err)
 		end,
 
+		test_buffered = function()
+			local h = levee.Hub()
+
+			local err, serve = h.stream:listen()
+			local err, addr = serve:addr()
+			local err, c = h.stream:dial(addr:port())
+			local err, s = serve:recv()
+
+			assert(not c:buffered(1024))
+			local stats = c:wstats()
+
+			-- writes are held until the end of the tick
+			c:write("foo")
+			c:write("bar")
+			assert.equal(stats.syscalls, 0)
+			assert.equal(s:reads(), "foobar")
+			assert.same(stats, {writes=2, flushes=1, syscalls=1, bytes=6})
+
+			c:write("baz")
+			assert(not c:flush())
+			assert.equal(stats.flushes, 2)
+			assert.equal(s:reads(), "baz")
+
+			-- a write over the threshold is flushed immediately
+			local big = ("x"):rep(4096)
+			c:write(big)
+			assert.equal(stats.flushes, 3)
+			local buf = d.Buffer()
+			s:readinto(buf, #big)
+			assert.equal(buf:take(), big)
+
+			-- as is anything still buffered on close
+			c:write("end")
+			c:close()
+			assert.equal(s:reads(), "end")
+			assert.equal(stats.flushes, 4)
+
+			s:close()
+			serve:close()
+		end,
+
+		test_buffered_parked = function()
+			local h = levee.Hub()
+
+			local err, serve = h.stream:listen()
+			local err, addr = serve:addr()
+			local err, c = h.stream:dial(addr:port())
+			local err, s = serve:recv()
+
+			assert(not c:buffered(1024))
+
+			-- more than the socket will take, so the flush parks on the fd
+			local big = ("x"):rep(8*1024*1024)
+			h:spawn(function() c:write(big) end)
+
+			-- neither a direct write nor close may overtake the parked flush
+			local after = "after"
+			local iov = h.io.iovec(1)
+			iov:write(after)
+			h:spawn(function()
+				assert(not c:writev(iov.iov, iov.n))
+				c:close()
+			end)
+
+			local buf = d.Buffer()
+			while true do
+				local err = s:readinto(buf)
+				if err then break end
+			end
+			assert.equal(#buf, #big + #after)
+			assert.equal(buf:peek(#big):find("after", 1, true), nil)
+			buf:trim(#big)
+			assert.equal(buf:take(), after)
+
+			s:close()
+			serve:close()
+		end,
+
+		test_buffered_parked_main = function()
+			local h = levee.Hub()
+
+			local err, serve = h.stream:listen()
+			local err, addr = serve:addr()
+			local err, c = h.stream:dial(addr:port())
+			local err, s = serve:recv()
+
+			assert(not c:buffered(1024))
+
+			local big = ("x"):rep(8*1024*1024)
+			h:spawn(function() c:write(big) end)
+
+			local buf = d.Buffer()
+			local sender, recver = h:pipe()
+			h:spawn(function()
+				while true do
+					local err = s:readinto(buf)
+					if err then break end
+				end
+				sender:send(true)
+			end)
+
+			-- the main thread waits behind the parked flush too
+			local after = "after"
+			local iov = h.io.iovec(1)
+			iov:write(after)
+			assert(not c:writev(iov.iov, iov.n))
+			c:close()
+
+			recver:recv()
+			assert.equal(#buf, #big + #after)
+			buf:trim(#big)
+			assert.equal(buf:take(), after)
+
+			s:close()
+			serve:close()
+		end,
+
+		test_memory = function()
+			local h = levee.Hub()
+
+			local err, serve = h.stream:listen()
+			local err, addr = serve:addr()
+			local err, c = h.stream:dial(addr:port())
+			local err, s = serve:recv()
+
+			assert.same(s:memory(), {read=0, write=0, total=0})
+
+			-- a read into an empty buffer is sized to what arrived
+			c:write("foo")
+			assert(not s.p:readin())
+			assert.equal(ffi.string(s.p:value()), "foo")
+			assert.equal(s:memory().read, 8192)
+
+			-- a large read grows it
+			c:write(("x"):rep(100000))
+			assert(not s.p:readin(100003))
+			assert.equal(s:memory().read, 131072)
+
+			-- once it's drained, waiting on the next read holds no memory
+			s.p:trim()
+			h:spawn(function() s.p:readin() end)
+			assert.same(s:memory(), {read=0, write=0, total=0})
+
+			c:write("bar")
+			h:sleep(10)
+			assert.equal(ffi.string(s.p:value()), "bar")
+			s.p:trim()
+			assert.equal(s:release(), 8192)
+
+			c:close()
+			s:close()
+			serve:close()
+		end,
+
+		test_memory_no_scratch = function()
+			local h = levee.Hub({io={scratch=false}})
+			local r, w = h.io:pipe()
+			w:write("foo")
+			assert(not r.p:readin())
+			r.p:trim()
+			-- without the scratch block an empty buffer keeps its block
+			h:spawn(function() r.p:readin() end)
+			assert.same(r:memory(), {read=8192, write=0, total=8192})
+			w:close()
+			r:close()
+		end,
+
+		test_mirror = function()
+			if not levee.d.Mirror:supported() then return "SKIP" end
+			local h = levee.Hub({io={mirror=true}})
+			local r, w = h.io:pipe()
+			assert(ffi.istype("LeveeMirror", r.p.rbuf))
+
+			local line = ("."):rep(99) .. "\n"
+			h:spawn(function()
+				for _ = 1, 1000 do w:write(line) end
+				w:close()
+			end)
+
+			-- trimming one line at a time wraps the mirror around its block
+			local n = 0
+			while true do
+				local err = r.p:readin(100)
+				if err then break end
+				assert.equal(ffi.string(r.p:value(100)), line)
+				r.p:trim(100)
+				n = n + 1
+			end
+			assert.equal(n, 1000)
+			assert(r.p.rbuf.cap <= 16384)
+			r:close()
+		end,
+
 		test_open = function()
 			local h = levee.Hub()
 
@@ -567,6 +760,35 @@ return {
 			assert.equal(s:take(), ("."):rep(10))
 		end,
 
+		test_pool = function()
+			if not _.splice then return "SKIP" end
+			local h = levee.Hub({io={splice_min=1, pipe_size=65536}})
+
+			local r, w = h.io:pipe()
+			local r2, w2 = h.io:pipe()
+			local s = r:stream()
+
+			-- each splice checks the same pipe out of the pool
+			for i = 1, 3 do
+				w:write(("."):rep(20))
+				local c = s:chunk(20)
+				assert.same({c:splice(w2)}, {nil, 20})
+				assert.equal(r2:reads(), ("."):rep(20))
+			end
+
+			assert.same(h.io.pipes:stats(),
+				{idle=1, hits=2, misses=1, puts=3, drops=0})
+
+			r:close()
+			w:close()
+			r2:close()
+			w2:close()
+			assert(not h:in_use())
+
+			h.io.pipes:clear()
+			assert.equal(h.io.pipes:stats().idle, 0)
+		end,
+
 		test_big = function()
 			local pre = ("."):rep(10)
 			local val = CHARS64:rep(512)
@@ -1,3 +1,5 @@
+local ffi = require("ffi")
+
 local levee = require("levee")
 
 
@@ -23,6 +25,51 @@ return {
 		assert.same({recver:recv()}, {nil, 3})
 	end,
 
+	test_channel_notify = function()
+		local h = levee.Hub()
+		h:continue()
+
+		local chan = h.thread:channel()
+		local recver = chan:bind()
+		local sender = recver:create_sender()
+
+		-- a burst only notifies the receiver once
+		for i = 1, 10 do sender:send(i) end
+		assert.same(chan:stats(), {notifies = 1})
+		h:continue()
+		for i = 1, 10 do assert.same({recver:recv()}, {nil, i}) end
+
+		-- draining re-arms the notification
+		sender:send(11)
+		assert.same(chan:stats(), {notifies = 2})
+		h:continue()
+		assert.same({recver:recv()}, {nil, 11})
+	end,
+
+	test_channel_capacity = function()
+		local h = levee.Hub({channel_capacity = 2})
+		h:continue()
+
+		local chan = h.thread:channel()
+		local recver = chan:bind()
+		local sender = recver:create_sender()
+
+		assert.equal(sender:send(1), 0)
+		assert.equal(sender:send(2), 0)
+		assert.equal(sender:send(3), -1)
+		assert.same(chan:stats(), {
+			notifies = 1, capacity = 2, depth = 2, high_water = 2, refused = 1, })
+
+		h:continue()
+		assert.same({recver:recv()}, {nil, 1})
+		assert.same({recver:recv()}, {nil, 2})
+		assert.equal(chan:stats().depth, 0)
+
+		assert.equal(sender:send(3), 0)
+		h:continue()
+		assert.same({recver:recv()}, {nil, 3})
+	end,
+
 	test_channel_table = function()
 		local h = levee.Hub()
 		h:continue()
@@ -67,6 +114,31 @@ return {
 		assert.same({parent.recver:recv()}, {nil, 321})
 	end,
 
+	test_pool_stats = function()
+		local h = levee.Hub()
+		h:continue()
+
+		local recver = h.thread:channel():bind()
+		local sender = recver:create_sender()
+
+		local function roundtrip()
+			for i = 1, 10 do sender:send(i) end
+			h:continue()
+			for i = 1, 10 do assert.same({recver:recv()}, {nil, i}) end
+		end
+
+		roundtrip()
+		local before = levee._.pool_stats()
+		assert(before.cached >= 10)
+
+		-- the second round reuses the nodes freed by the first
+		roundtrip()
+		local after = levee._.pool_stats()
+		assert(after.hits - before.hits >= 10)
+		assert.equal(before.misses, after.misses)
+		assert(after.hit_rate > 0)
+	end,
+
 	test_call = function()
 		local h = levee.Hub()
 
@@ -105,6 +177,71 @@ return {
 		assert.same({child:recv()}, {levee.errors.get(1)})
 	end,
 
+	test_spawn_capacity = function()
+		local h = levee.Hub({channel_capacity = 4})
+
+		local child = h.thread:spawn(function(h)
+			for i = 1, 100 do h.parent:send(i) end
+		end)
+
+		-- block this thread without pumping the hub so the child fills the
+		-- channel and has to wait for space
+		ffi.C.usleep(50*1000)
+		local stats = h.thread:channel():stats()
+		assert.equal(stats.depth, 4)
+		assert.equal(stats.refused, 1)
+
+		for i = 1, 100 do assert.same({child:recv()}, {nil, i}) end
+		assert.equal(h.thread:channel():stats().high_water, 4)
+	end,
+
+	test_spawn_fan_in = function()
+		local h = levee.Hub()
+
+		local children = {}
+		for i = 1, 4 do
+			children[i] = h.thread:spawn(function(h)
+				for i = 1, 1000 do h.parent:send(i) end
+			end)
+		end
+
+		-- each producer's messages arrive in the order they were sent
+		for i = 1, 4 do
+			for j = 1, 1000 do assert.same({children[i]:recv()}, {nil, j}) end
+		end
+	end,
+
+	test_spawn_capacity_senders = function()
+		local h = levee.Hub({channel_capacity = 2})
+
+		-- several green threads in the child wait on the same full channel
+		local child = h.thread:spawn(function(h)
+			local done = 0
+			for i = 1, 4 do
+				h:spawn(function()
+					for j = 1, 25 do h.parent:send(i * 100 + j) end
+					done = done + 1
+				end)
+			end
+			while done < 4 do h:sleep(1) end
+			h:sleep(10)
+			-- the space pipe is let go once no one is waiting on it
+			h.parent:send(next(h.thread.spaces) == nil and not h:in_use())
+		end)
+
+		ffi.C.usleep(50*1000)
+		local seen = {}
+		for i = 1, 100 do
+			local err, value = child:recv()
+			assert(not err)
+			seen[value] = true
+		end
+		for i = 1, 4 do
+			for j = 1, 25 do assert(seen[i * 100 + j]) end
+		end
+		assert.same({child:recv()}, {nil, true})
+	end,
+
 	test_buffer = function()
 		local h = levee.Hub()
 
@@ -122,6 +259,39 @@ return {
 		assert.equal(buf:take(), "foobar123")
 	end,
 
+	test_buffer_pool = function()
+		local h = levee.Hub()
+
+		local function f(h)
+			local levee = require("levee")
+			for i = 1, 10 do
+				local buf = levee.d.Buffer(4096)
+				buf:push("foobar" .. i)
+				h.parent:send(buf)
+			end
+		end
+
+		collectgarbage("collect")
+		local before = levee.d.Buffer:pool_stats()
+
+		local child = h.thread:spawn(f)
+		for i = 1, 10 do
+			local err, buf = child:recv()
+			assert.equal(buf:take(), "foobar" .. i)
+		end
+		collectgarbage("collect")
+
+		-- the received blocks go back to the shared pool
+		local after = levee.d.Buffer:pool_stats()
+		assert(after.puts - before.puts >= 10)
+
+		-- where the receiving thread picks them up again
+		local bufs = {}
+		for i = 1, 10 do bufs[i] = levee.d.Buffer(4096) end
+		local reused = levee.d.Buffer:pool_stats()
+		assert(reused.hits - after.hits >= 10)
+	end,
+
 	test_timeout = function()
 		local function f(h)
 			h:sleep(50)
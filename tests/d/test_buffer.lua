@@ -110,4 +110,79 @@ return {
 		assert.equal(buf:peek(), "foo")
 		assert.equal(butt:peek(), "")
 	end,
+
+	test_pool = function()
+		collectgarbage("collect")
+		d.Buffer:pool_clear()
+		local stats = d.Buffer:pool_stats()
+		assert.equal(stats.cached, 0)
+		assert.equal(stats.bytes, 0)
+
+		local buf = d.Buffer(4096)
+		buf:write("foo")
+		buf:freeze(3)
+		buf = nil
+		collectgarbage("collect")
+
+		-- the frozen buffer's whole block went back to the pool
+		local before = d.Buffer:pool_stats()
+		assert.equal(before.cached, 1)
+		assert.equal(before.bytes, 8192)
+		assert.equal(before.puts - stats.puts, 1)
+
+		-- and is handed out again
+		buf = d.Buffer(4096)
+		local after = d.Buffer:pool_stats()
+		assert.equal(after.hits - before.hits, 1)
+		assert.equal(after.misses, before.misses)
+		assert.equal(after.cached, 0)
+
+		-- growing returns the outgrown block
+		buf:write("bar")
+		buf:ensure(16384)
+		assert.equal(buf:peek(), "bar")
+		after = d.Buffer:pool_stats()
+		assert.equal(after.cached, 1)
+		assert.equal(after.bytes, 8192)
+
+		-- blocks larger than LEVEE_BUFFER_MAX_BLOCK aren't pooled
+		local big = d.Buffer(200000)
+		big = nil
+		collectgarbage("collect")
+		after = d.Buffer:pool_stats()
+		assert.equal(after.cached, 1)
+
+		d.Buffer:pool_clear()
+		assert.equal(d.Buffer:pool_stats().cached, 0)
+	end,
+
+	test_shrink = function()
+		local buf = d.Buffer()
+		assert.equal(buf.cap, 0)
+
+		buf:write(("x"):rep(100000))
+		assert.equal(buf.cap, 131072)
+
+		-- a buffer with data only shrinks to fit it
+		buf:trim(99000)
+		assert.equal(buf:shrink(), 131072 - 8192)
+		assert.equal(buf.cap, 8192)
+		assert.equal(buf:peek(), ("x"):rep(1000))
+		assert.equal(buf:release(), 0)
+
+		-- an empty buffer hands its block back, and borrows one when needed
+		buf:trim()
+		assert.equal(buf:release(), 8192)
+		assert.equal(buf.cap, 0)
+		assert.equal(buf:available(), 0)
+		buf:ensure()
+		assert.equal(buf.cap, 8192)
+		buf:write("foo")
+		assert.equal(buf:peek(), "foo")
+
+		-- shrinking to a size keeps at least that much
+		buf:ensure(60000)
+		assert.equal(buf:shrink(16384), 65536 - 16384)
+		assert.equal(buf:peek(), "foo")
+	end,
 }
@@ -89,6 +89,17 @@ return {
 		assert.same(REFS, {})
 	end,
 
+	test_expire = function()
+		local h = d.Heap()
+		h:push(10, "a")
+		h:push(20, "b")
+		assert.equals(nil, h:expire(5))
+		assert.same({h:expire(15)}, {10LL, "a"})
+		assert.equals(nil, h:expire(15))
+		assert.same({h:expire(20)}, {20LL, "b"})
+		assert.equals(0, #h)
+	end,
+
 	test_destroy = function()
 		local ffi = require('ffi')
 		local freed = false
@@ -0,0 +1,129 @@
+local ffi = require('ffi')
+
+
+local d = require("levee").d
+
+
+return {
+	skipif = function() return not d.Mirror:supported() end,
+
+	test_core = function()
+		local buf = d.Mirror(4096)
+		assert.equal(#buf, 0)
+		assert.equal(buf:peek(), "")
+		assert.equal(buf:available(), buf.cap)
+
+		local s = ("."):rep(1024)
+
+		for i = 1, 10 do
+			local size = i * 1024
+
+			buf:ensure(size)
+			ffi.copy(buf:tail(), s)
+			buf:bump(#s)
+
+			assert.equal(#buf, size)
+			assert.equal(buf:peek(), ("."):rep(size))
+		end
+
+		assert.equal(buf:trim(5120), 5120)
+		assert.equal(#buf, 5120)
+		assert.equal(buf:peek(), ("."):rep(5120))
+
+		assert.equal(buf:trim(), 5120)
+		assert.equal(#buf, 0)
+		assert.equal(buf.off, 0)
+	end,
+
+	test_wrap = function()
+		local buf = d.Mirror(8192)
+		local cap = buf.cap
+
+		-- fill the block and trim from the front without ever moving the
+		-- contents down, so the contents soon straddle the end of the block
+		local n = 0
+		local next = 0
+		local function fill()
+			while buf:available() >= 10 do
+				buf:push(("%010d"):format(n))
+				n = n + 1
+			end
+		end
+
+		for _ = 1, 50 do
+			fill()
+			assert.equal(buf.cap, cap)
+			for _ = 1, 333 do
+				assert.equal(buf:take(10), ("%010d"):format(next))
+				next = next + 1
+			end
+			assert(buf.off < cap)
+		end
+
+		-- values that wrap are still contiguous
+		local value, len = buf:value()
+		assert.equal(len, #buf)
+		assert.equal(ffi.string(value, 10), ("%010d"):format(next))
+	end,
+
+	test_grow = function()
+		local buf = d.Mirror(8192)
+		local cap = buf.cap
+		buf:push(("x"):rep(cap - 100))
+		buf:trim(cap - 200)
+		buf:push(("y"):rep(cap - 200))
+		-- the contents now wrap
+		assert(buf.off + #buf > cap)
+		buf:ensure(cap)
+		assert(buf.cap > cap)
+		assert.equal(buf.off, 0)
+		assert.equal(buf:peek(), ("x"):rep(100) .. ("y"):rep(cap - 200))
+	end,
+
+	test_save = function()
+		local buf = d.Mirror(8192)
+		buf:push("012345678901234567890123456789")
+
+		buf:trim(10)
+		buf:freeze(10)
+		assert.equal(buf:peek(), "0123456789")
+
+		buf:trim(9)
+		buf:push("oh hai")
+		assert.equal(buf:peek(), "9oh hai")
+
+		buf:thaw()
+		assert.equal(buf:peek(), "01234567899oh hai")
+	end,
+
+	test_butt = function()
+		local buf = d.Mirror(8192)
+		buf:push("01234567890123456789")
+		local butt = buf:butt(5)
+		assert.equal(#butt, 15)
+		assert.equal(butt:trim(5), 5)
+		assert.equal(buf:peek(), "012340123456789")
+	end,
+
+	test_release = function()
+		local buf = d.Mirror(8192)
+		local cap = buf.cap
+		buf:push("foo")
+		assert.equal(buf:release(), 0)
+		buf:trim()
+		assert.equal(buf:release(), cap)
+		assert.equal(buf.cap, 0)
+		buf:push("bar")
+		assert.equal(buf:peek(), "bar")
+	end,
+
+	test_stream = function()
+		-- a Mirror stands in for a Buffer under the protocol parsers
+		local buf = d.Mirror()
+		local msgpack = require("levee.p").msgpack
+		assert(not msgpack.encode({foo="bar"}, buf))
+		local err, value = msgpack.decode(buf)
+		assert(not err)
+		assert.same(value, {foo="bar"})
+	end,
+}
@@ -0,0 +1,38 @@
+local d = require("levee").d
+
+return {
+	test_push_pop = function()
+		local r = d.Ring()
+		assert.equals(0, #r)
+		r:push(1, "a")
+		r:push(2, nil, nil, "d")
+		assert.equals(2, #r)
+		assert.same({r:pop()}, {1, "a"})
+		assert.same({r:peek()}, {2, nil, nil, "d"})
+		assert.same({r:pop()}, {2, nil, nil, "d"})
+		assert.equals(0, #r)
+	end,
+
+	test_grow = function()
+		local r = d.Ring(16)
+		assert.equals(16, r.size)
+
+		-- offset head so growing has to unwrap the ring
+		for i = 1, 10 do r:push(i) end
+		for i = 1, 10 do r:pop() end
+
+		for i = 1, 40 do r:push(i, i * 2) end
+		assert.equals(40, #r)
+		assert.equals(64, r.size)
+		for i = 1, 40 do
+			assert.same({r:pop()}, {i, i * 2})
+		end
+		assert.equals(0, #r)
+	end,
+
+	test_empty = function()
+		local r = d.Ring()
+		assert(not pcall(r.pop, r))
+		assert(not pcall(r.peek, r))
+	end,
+}
@@ -0,0 +1,88 @@
+local REFS = require("levee.d.wheel").REFS
+local d = require("levee").d
+
+
+return {
+	test_push_expire = function()
+		local w = d.Wheel(1000)
+		assert.equals(nil, w:peek())
+		assert.equals(nil, w:expire(1000))
+
+		w:push(1010, "a")
+		w:push(1005, "b")
+		w:push(1010, "c")
+		assert.equals(3, #w)
+		assert.equals(1005, w:peek())
+
+		assert.equals(nil, w:expire(1004))
+		assert.same({w:expire(1005)}, {1005LL, "b"})
+		assert.equals(nil, w:expire(1009))
+
+		local got = {}
+		for expires, val in function() return w:expire(1010) end do
+			assert.equals(1010, expires)
+			table.insert(got, val)
+		end
+		table.sort(got)
+		assert.same(got, {"a", "c"})
+		assert.equals(0, #w)
+	end,
+
+	test_past = function()
+		local w = d.Wheel(1000)
+		w:push(900, "a")
+		assert.equals(1000, w:peek())
+		assert.same({w:expire(1000)}, {900LL, "a"})
+	end,
+
+	test_remove = function()
+		local w = d.Wheel(0)
+		local a = w:push(10, "a")
+		local b = w:push(5000, "b")
+		w:push(20, "c")
+		a:remove()
+		b:remove()
+		assert.equals(1, #w)
+		assert.same({w:expire(100000)}, {20LL, "c"})
+		assert.equals(nil, w:expire(100000))
+	end,
+
+	test_cascade = function()
+		-- timers spanning every level, plus one beyond the wheel's range
+		local w = d.Wheel(0)
+		math.randomseed(0)
+		local want = {}
+		for i = 1, 200 do
+			local expires = math.random(2^(6 * (i % 6)))
+			w:push(expires, i)
+			want[i] = expires
+		end
+		w:push(4294967296LL, "far")
+
+		local now, n = 0, 0
+		while n < 200 do
+			local next = w:peek()
+			assert(next >= now)
+			now = next
+			for expires, i in function() return w:expire(now) end do
+				assert.equals(want[i], tonumber(expires))
+				assert(expires <= now)
+				n = n + 1
+			end
+		end
+		assert.equals(1, #w)
+		assert.equals(nil, w:expire(4294967295LL))
+		assert.same({w:expire(4294967296LL)}, {4294967296LL, "far"})
+	end,
+
+	test_clear = function()
+		local w = d.Wheel(0)
+		for i = 1, 10 do w:push(i * 100, i) end
+		w:clear()
+		assert.equals(0, #w)
+		assert.equals(nil, w:expire(10000))
+		w = nil
+		collectgarbage("collect")
+		assert.same(REFS, {})
+	end,
+}
@@ -56,4 +56,80 @@ return {
 		s1:close()
 		s2:close()
 	end,
+
+	test_many = function()
+		local h = levee.Hub()
+
+		local err, s1 = h.dgram:bind()
+		local err, s2 = h.dgram:bind()
+		local err, ep1 = s1:addr()
+		local err, ep2 = s2:addr()
+
+		local send = h.dgram:batch(4)
+		local recv = h.dgram:batch(4)
+
+		assert(not send:push(ep2, "foo"))
+		assert(not send:push(ep2, "foobar"))
+		assert(not send:push(ep2, ""))
+		local err, n = s1:sendmany(send)
+		assert(not err)
+		assert.equal(n, 3)
+		assert.equal(send.count, 0)
+
+		local err, n = s2:recvmany(recv)
+		assert(not err)
+		assert.equal(n, 3)
+		assert.equal(recv:string(1), "foo")
+		assert.equal(recv:string(2), "foobar")
+		assert.equal(recv:string(3), "")
+		assert.equal(tostring(recv:endpoint(1)), tostring(ep1))
+
+		-- the batch is reused, and a receive can be limited
+		for i = 1, 4 do assert(not send:push(ep1, tostring(i))) end
+		assert(send:push(ep1, "5"))
+		s2:sendmany(send)
+		local err, n = s1:recvmany(recv, 3)
+		assert.equal(n, 3)
+		assert.equal(recv:string(3), "3")
+		local err, n = s1:recvmany(recv)
+		assert.equal(n, 1)
+		assert.equal(recv:string(1), "4")
+
+		-- test recvmany blocks until ready
+		h:spawn(function() h:sleep(10); s1:sendto(ep2, "foo") end)
+		local err, n = s2:recvmany(recv)
+		assert.equal(n, 1)
+		assert.equal(recv:string(1), "foo")
+
+		s1:close()
+		s2:close()
+	end,
+
+	test_gso = function()
+		local h = levee.Hub()
+
+		local err, s1 = h.dgram:bind()
+		local err, s2 = h.dgram:bind()
+		local err, ep2 = s2:addr()
+
+		if s1:gso(4) or s2:gro() then return "SKIP" end
+
+		local batch = h.dgram:batch(4)
+		s1:sendto(ep2, "aaaabbbbcc")
+		local err, n = s2:recvmany(batch)
+		assert.equal(n, 1)
+		assert.equal(batch:string(1), "aaaabbbbcc")
+		assert.equal(batch:segment(1), 4)
+
+		-- without gro each segment arrives as a datagram
+		s2:gro(false)
+		s1:sendto(ep2, "aaaabbbbcc")
+		local err, n = s2:recvmany(batch)
+		assert.equal(n, 3)
+		assert.equal(batch:string(3), "cc")
+		assert.equal(batch:segment(1), nil)
+
+		s1:close()
+		s2:close()
+	end,
 }
@@ -95,4 +95,86 @@ end
 return {
 	sync = __tests(),
 	async = __tests(true),
+
+	resolver = {
+		test_cache = function()
+			local h = levee.Hub()
+			h.dialer:flush()
+
+			local err, serve = server(h)
+
+			local function dial()
+				local err, conn = h.dialer:dial(
+					C.AF_INET, C.SOCK_STREAM, "localhost", serve.port)
+				assert(not err)
+				local err, s = serve:recv()
+				s:close()
+				h:unregister(conn.no, true, true)
+				h:continue()
+			end
+
+			local before = h.dialer:stats()
+			dial()
+			local after = h.dialer:stats()
+			assert.equal(after.misses - before.misses, 1)
+			assert.equal(after.resolved - before.resolved, 1)
+			assert(after.cached >= 1)
+
+			-- dialing the same node and service again doesn't resolve
+			dial()
+			local again = h.dialer:stats()
+			assert.equal(again.hits - after.hits, 1)
+			assert.equal(again.resolved, after.resolved)
+
+			h.dialer:flush()
+			assert.equal(h.dialer:stats().cached, 0)
+			serve:close()
+		end,
+
+		test_negative = function()
+			local h = levee.Hub()
+			h.dialer:flush()
+
+			local before = h.dialer:stats()
+			for i = 1, 2 do
+				local err, conn = h.dialer:dial(
+					C.AF_INET, C.SOCK_STREAM, "kdkd", 5555)
+				assert.equal(err, errors.addr.ENONAME)
+			end
+			local after = h.dialer:stats()
+			assert.equal(after.failed - before.failed, 1)
+			assert.equal(after.negative - before.negative, 1)
+			h.dialer:flush()
+		end,
+
+		test_concurrent = function()
+			local h = levee.Hub({dialer={threads=8}})
+			h.dialer:flush()
+
+			local err, serve = server(h)
+
+			-- dials from many green threads are in flight at once
+			local sender, recver = h:queue()
+			for i = 1, 8 do
+				h:spawn(function()
+					local err, conn = h.dialer:dial(
+						C.AF_INET, C.SOCK_STREAM, "localhost", serve.port)
+					assert(not err)
+					sender:send(conn)
+				end)
+			end
+			for i = 1, 8 do
+				local err, s = serve:recv()
+				s:close()
+				local err, conn = recver:recv()
+				h:unregister(conn.no, true, true)
+			end
+			h:continue()
+
+			assert(h.dialer:stats().threads >= 8)
+			h.dialer:flush()
+			serve:close()
+			assert(not h:in_use())
+		end,
+	},
 }
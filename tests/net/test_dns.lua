@@ -70,6 +70,52 @@ local function record(r)
 end
 
 
+local function cache(poller)
+	local h = levee.Hub({poller=poller})
+	-- falls back to epoll on kernels without io_uring
+	if poller and h.poller.backend ~= poller then return "SKIP" end
+
+	local host = "127.0.0.1"
+	local port = 1053
+
+	h:spawn(function()
+		local err, s = h.dgram:bind(port, host)
+		respond(s, "imgx-com-a")
+		s:close()
+	end)
+
+	-- resolves for the same name while a query is in flight share it
+	local opts = {port=port, host=host}
+	local sender, recver = h:pipe()
+	for i = 1, 3 do
+		h:spawn(function()
+			local err, records = h.dns:resolve("imgx.com", "A", opts)
+			assert(not err)
+			sender:send(records[1].record)
+		end)
+	end
+	for i = 1, 3 do
+		local err, value = recver:recv()
+		assert.equal(value, "162.255.119.249")
+	end
+
+	-- and later ones are answered from the cache
+	local err, records = h.dns:resolve("IMGX.com", "A", opts)
+	assert(not err)
+	assert.equal(records[1].record, "162.255.119.249")
+
+	local stats = h.dns:stats()
+	assert.equal(stats.queries, 1)
+	assert.equal(stats.misses, 1)
+	assert.equal(stats.coalesced, 2)
+	assert.equal(stats.hits, 1)
+	assert.equal(stats.cached, 1)
+
+	h.dns:flush()
+	assert.equal(h.dns:stats().cached, 0)
+end
+
+
 return {
 	test_core = function()
 		local h = levee.Hub()
@@ -296,6 +342,177 @@ return {
 		assert.equal(#records, 1)
 	end,
 
+	test_concurrent = function()
+		local h = levee.Hub()
+
+		local host = "127.0.0.1"
+		local port = 1053
+		local names = {"imgx-com-a", "yahoo-com-a", "opendns-org-cname-a"}
+
+		-- answer all three queries, last asked first
+		h:spawn(function()
+			local err, s = h.dgram:bind(port, host)
+			local buf = levee.d.Buffer(4096)
+			local asked = {}
+			for i = 1, #names do
+				local err, who, n = s:recvfrom(buf:tail())
+				buf:bump(n)
+				table.insert(asked, {who=who, qid=string.sub(buf:take(), 1, 2)})
+			end
+			for i = #names, 1, -1 do
+				s:sendto(asked[i].who, asked[i].qid..response(names[i]))
+			end
+			s:close()
+		end)
+
+		local opts = {port=port, host=host}
+		local sender, recver = h:pipe()
+		local qnames = {"imgx.com", "yahoo.com", "opendns.org"}
+		for i = 1, #qnames do
+			h:spawn(function()
+				local err, records = h.dns:resolve(qnames[i], "A", opts)
+				assert(not err)
+				sender:send({i, #records})
+			end)
+		end
+
+		local got = {}
+		for i = 1, #qnames do
+			local err, value = recver:recv()
+			got[value[1]] = value[2]
+		end
+		assert.same(got, {1, 3, 1})
+
+		-- all three went out on the same socket, sharing one parsed resolv.conf
+		local stats = h.dns:stats()
+		assert.equal(stats.queries, 3)
+		assert.equal(stats.pending, 0)
+		assert.equal(stats.loads, 1)
+	end,
+
+	test_cache = function()
+		return cache()
+	end,
+
+	test_cache_uring = function()
+		return cache("uring")
+	end,
+
+	test_question_mismatch = function()
+		local h = levee.Hub()
+
+		local host = "127.0.0.1"
+		local port = 1053
+
+		h:spawn(function()
+			local err, s = h.dgram:bind(port, host)
+			local buf = levee.d.Buffer(4096)
+			local err, who, n = s:recvfrom(buf:tail())
+			buf:bump(n)
+			local qid = string.sub(buf:take(), 1, 2)
+			-- the right id, but an answer for another name, then the real one
+			s:sendto(who, qid..response("yahoo-com-a"))
+			s:sendto(who, qid..response("imgx-com-a"))
+			s:close()
+		end)
+
+		local opts = {port=port, host=host}
+		local err, records = h.dns:resolve("imgx.com", "A", opts)
+		assert(not err)
+		assert.equal(records[1].record, "162.255.119.249")
+		assert.equal(h.dns:stats().stale, 1)
+	end,
+
+	test_cache_negative = function()
+		local h = levee.Hub()
+
+		local host = "127.0.0.1"
+		local port = 1053
+
+		h:spawn(function()
+			local err, s = h.dgram:bind(port, host)
+			local buf = levee.d.Buffer(4096)
+			local err, who, n = s:recvfrom(buf:tail())
+			buf:bump(n)
+			local query = buf:take()
+			-- NXDOMAIN, with an SOA for the name with a ttl of 600 and a
+			-- minimum of 60
+			local soa = "" ..
+				"\xc0\x0c\x00\x06\x00\x01\x00\x00\x02\x58\x00\x20" ..
+				"\x02ns\xc0\x0c\x04host\xc0\x0c" ..
+				"\x00\x00\x00\x01\x00\x00\x0e\x10\x00\x00\x02\x58" ..
+				"\x00\x09\x3a\x80\x00\x00\x00\x3c"
+			s:sendto(who, query:sub(1, 2) ..
+				"\x81\x83\x00\x01\x00\x00\x00\x01\x00\x00" ..
+				query:sub(13) .. soa)
+			s:close()
+		end)
+
+		local opts = {port=port, host=host}
+		local err = h.dns:resolve("nope.imgx.com", "A", opts)
+		assert.equal(err, errors.dns.NXDOMAIN)
+		local err = h.dns:resolve("nope.imgx.com", "A", opts)
+		assert.equal(err, errors.dns.NXDOMAIN)
+
+		local stats = h.dns:stats()
+		assert.equal(stats.queries, 1)
+		assert.equal(stats.negative, 1)
+		local __, entry = next(h.dns.cache.nodes)
+		assert.equal(entry.value.ttl, 60000)
+	end,
+
+	test_cache_prefetch = function()
+		local h = levee.Hub({dns={prefetch=1}})
+
+		local host = "127.0.0.1"
+		local port = 1053
+
+		h:spawn(function()
+			local err, s = h.dgram:bind(port, host)
+			respond(s, "imgx-com-a")
+			respond(s, "imgx-com-a")
+			s:close()
+		end)
+
+		local opts = {port=port, host=host}
+		assert(not h.dns:resolve("imgx.com", "A", opts))
+		h:sleep(5)
+		-- answered from the cache, while a refresh is sent in the background
+		assert(not h.dns:resolve("imgx.com", "A", opts))
+		h:sleep(5)
+
+		local stats = h.dns:stats()
+		assert.equal(stats.prefetches, 1)
+		assert.equal(stats.queries, 2)
+		assert.equal(stats.hits, 1)
+	end,
+
+	test_reload = function()
+		local h = levee.Hub()
+		-- stat resolv.conf on every query
+		h.dns.recheck = 0
+
+		local tmp = _.path.Path:tmpdir()
+		defer(function() tmp:remove(true) end)
+		tmp = tmp("resolvconf")
+		tmp:write("nameserver 0.0.0.1")
+		local opts = {resconf=tostring(tmp)}
+
+		local err, conf = h.dns:conf(opts)
+		assert(not err)
+		assert.equal(#conf.nameservers, 1)
+
+		-- unchanged, so the parsed copy is kept
+		local err, again = h.dns:conf(opts)
+		assert.equal(again, conf)
+		assert.equal(h.dns:stats().loads, 1)
+
+		tmp:write("nameserver 0.0.0.1\nnameserver 0.0.0.2\n")
+		local err, conf = h.dns:conf(opts)
+		assert.equal(#conf.nameservers, 2)
+		assert.equal(h.dns:stats().loads, 2)
+	end,
+
 	test_rcode = function()
 		local h = levee.Hub()
 
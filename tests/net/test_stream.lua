@@ -124,4 +124,179 @@ return {
 		assert.equal(c.options.host, "localhost")
 		serve:recv()
 	end,
+
+	test_accept_stats = function()
+		local h = levee.Hub()
+		local err, serve = h.stream:listen({port=0, accept_budget=2})
+
+		local conns = {}
+		for i = 1, 3 do
+			local err, c = h.stream:dial(serve:port())
+			assert(not err)
+			table.insert(conns, c)
+		end
+		for i = 1, 3 do
+			local err, s = serve:recv()
+			assert(not err)
+			s:close()
+		end
+
+		local stats = serve:stats()
+		assert.equal(stats.accepted, 3)
+		assert.equal(stats.refused, 0)
+		assert.equal(stats.pending, 0)
+
+		for __, c in ipairs(conns) do c:close() end
+		serve:close()
+	end,
+
+	test_accept_max_pending = function()
+		local h = levee.Hub()
+		local err, serve = h.stream:listen({port=0, max_pending=1})
+
+		for i = 1, 3 do
+			local err, c = h.stream:dial(serve:port())
+			assert(not err)
+		end
+		h:sleep(20)
+		assert.same(serve:stats(),
+			{accepted=2, deferred=1, refused=0, pending=1})
+
+		for i = 1, 3 do
+			local err, s = serve:recv()
+			assert(not err)
+		end
+		assert.same(serve:stats(),
+			{accepted=3, deferred=2, refused=0, pending=0})
+		serve:close()
+	end,
+
+	test_accept_refuse = function()
+		local h = levee.Hub()
+		local err, serve = h.stream:listen({port=0, max_pending=1, refuse=true})
+
+		local conns = {}
+		for i = 1, 3 do
+			local err, c = h.stream:dial(serve:port())
+			assert(not err)
+			table.insert(conns, c)
+		end
+		h:sleep(20)
+		assert.same(serve:stats(),
+			{accepted=1, deferred=0, refused=2, pending=1})
+
+		local buf = levee.d.Buffer(4096)
+		assert.equal(conns[3]:readinto(buf), levee.errors.CLOSED)
+		serve:close()
+	end,
+
+	test_reuseport = function()
+		local h = levee.Hub()
+		local err, s1 = h.stream:listen({port=0, reuseport=true})
+		assert(not err)
+		local err, s2 = h.stream:listen({port=s1:port(), reuseport=true})
+		assert(not err)
+		assert.equal(s1:port(), s2:port())
+		s1:close()
+		s2:close()
+		assert(not h:in_use())
+	end,
+
+	test_close_fd = function()
+		local h = levee.Hub()
+
+		local err, serve = h.stream:listen()
+		local err, addr = serve:addr()
+		local err, c = h.stream:dial(addr:port())
+		local err, s = serve:recv()
+
+		-- closing releases the fd itself, not just its registration
+		local nos = {c.no, s.no, serve.no}
+		c:close()
+		s:close()
+		serve:close()
+		h:sleep(10)
+		for __, no in ipairs(nos) do
+			assert(_.fstat(no))
+		end
+		assert(not h:in_use())
+	end,
+
+	test_cluster = function()
+		local h = levee.Hub()
+
+		local function worker(h, serve, index)
+			for conn in serve do
+				h:spawn(function()
+					local buf = require("levee").d.Buffer(4096)
+					conn:readinto(buf)
+					conn:write(tostring(index))
+					conn:close()
+				end)
+			end
+		end
+
+		local err, cluster = h.tcp:listen({cluster=2, worker=worker})
+		assert(not err)
+		assert(cluster:port() > 0)
+		assert.same(cluster:stats(), {workers=2, alive=2, restarts=0})
+
+		local buf = levee.d.Buffer(4096)
+		for i = 1, 4 do
+			local err, c = h.tcp:dial(cluster:port())
+			assert(not err)
+			c:write("hi")
+			c:readinto(buf)
+			local index = tonumber(buf:take())
+			assert(index == 1 or index == 2)
+			c:close()
+		end
+
+		cluster:close()
+		h:sleep(200)
+		assert.same(cluster:stats(), {workers=2, alive=0, restarts=0})
+	end,
+
+	test_cluster_respawn = function()
+		local h = levee.Hub()
+
+		local function worker(h, serve, index)
+			error("crash")
+		end
+
+		local err, cluster = h.tcp:listen({
+			cluster = {workers=1, backoff=10, max_restarts=2},
+			worker = worker, })
+		assert(not err)
+
+		h:sleep(500)
+		assert.same(cluster:stats(), {workers=1, alive=0, restarts=2})
+		cluster:close()
+	end,
+
+	test_cluster_exit = function()
+		local h = levee.Hub()
+
+		local function worker(h, serve, index)
+		end
+
+		-- a worker that returns is done
+		local err, cluster = h.tcp:listen({
+			cluster = {workers=1, backoff=10, max_restarts=2},
+			worker = worker, })
+		assert(not err)
+		h:sleep(200)
+		assert.same(cluster:stats(), {workers=1, alive=0, restarts=0})
+		cluster:close()
+
+		-- unless it's asked to be kept running
+		local err, cluster = h.tcp:listen({
+			cluster = {
+				workers=1, backoff=10, max_restarts=2, respawn_exited=true},
+			worker = worker, })
+		assert(not err)
+		h:sleep(500)
+		assert.same(cluster:stats(), {workers=1, alive=0, restarts=2})
+		cluster:close()
+	end,
 }
@@ -1,3 +1,62 @@
+local function pool(poller)
+	local levee = require("levee")
+	local h = levee.Hub({
+		poller=poller, http={pool={max_active=1, timeout=20}}})
+	-- falls back to epoll on kernels without io_uring
+	if poller and h.poller.backend ~= poller then return "SKIP" end
+
+	local err, serve = h.http:listen()
+	local err, addr = serve:addr()
+
+	local err, c = h.http.pool:checkout(addr:port())
+	local err, response = c:get("/path")
+	local err, s = serve:recv()
+	local err, req = s:recv()
+	req.response:send({levee.HTTPStatus(200), {}, "Hello world\n"})
+	local err, response = response:recv()
+	assert.equal(response.body:tostring(), "Hello world\n")
+
+	-- the upstream is exhausted
+	local err = h.http.pool:checkout(addr:port())
+	assert.equal(err, levee.errors.TIMEOUT)
+
+	-- a waiter is handed the client when it's checked in
+	h:spawn_later(10, function() h.http.pool:checkin(c) end)
+	local err, c2 = h.http.pool:checkout(addr:port())
+	assert.equal(c2, c)
+	h.http.pool:checkin(c2)
+
+	-- an idle client is reused
+	local err, c2 = h.http.pool:checkout(addr:port())
+	assert.equal(c2, c)
+	h.http.pool:checkin(c2)
+
+	-- unless its peer has hung up
+	s:close()
+	h:sleep(10)
+	local err, c2 = h.http.pool:checkout(addr:port())
+	assert(c2 ~= c)
+	local err, s = serve:recv()
+	h.http.pool:checkin(c2)
+
+	local stats = h.http.pool:stats()
+	assert.equal(stats.checkouts, 5)
+	assert.equal(stats.reused, 2)
+	assert.equal(stats.dials, 2)
+	assert.equal(stats.waits, 2)
+	assert.equal(stats.timeouts, 1)
+	assert.equal(stats.evicted, 1)
+	assert.equal(stats.idle, 1)
+	assert.equal(stats.active, 0)
+
+	h.http.pool:clear()
+	s:close()
+	serve:close()
+	h:sleep(10)
+	assert(not h:in_use())
+end
+
+
 return {
 	test_basic = function()
 		local levee = require("levee")
@@ -529,6 +588,48 @@ return {
 		assert(err)
 	end,
 
+	test_pool = function()
+		return pool()
+	end,
+
+	test_pool_uring = function()
+		return pool("uring")
+	end,
+
+	test_pool_handoff_timeout = function()
+		local levee = require("levee")
+		local h = levee.Hub({http={pool={max_active=1}}})
+
+		local err, serve = h.http:listen()
+		local err, addr = serve:addr()
+
+		local err, c = h.http.pool:checkout(addr:port())
+		assert(not err)
+
+		-- the checkin and the waiter's timeout land together. whichever wins,
+		-- the client ends up back in the pool
+		local got
+		h:spawn(function()
+			got = {h.http.pool:checkout(addr:port(), nil, {wait=10})}
+		end)
+		h:spawn_later(10, function() h.http.pool:checkin(c) end)
+		h:sleep(30)
+
+		if got[1] then
+			assert.equal(got[1], levee.errors.TIMEOUT)
+		else
+			assert.equal(got[2], c)
+			h.http.pool:checkin(c)
+		end
+		local stats = h.http.pool:stats()
+		assert.equal(stats.active, 0)
+		assert.equal(stats.idle, 1)
+
+		h.http.pool:clear()
+		serve:close()
+		h:sleep(10)
+	end,
+
 	test_connect_timeout = function()
 		local levee = require("levee")
 		local h = levee.Hub()
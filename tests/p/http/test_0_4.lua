@@ -413,6 +413,111 @@ return {
 		assert.equal(ffi.string(stream:value(), req.len), "Hello World!\n")
 	end,
 
+	test_decode_request_lazy = function()
+		local levee = require("levee")
+
+		local fields = "" ..
+			"Host: example.com\r\n" ..
+			"H1: one\r\n" ..
+			"H2: two\r\n" ..
+			"H2: too\r\n" ..
+			"Date: Sun, 18 Oct 2009 08:56:53 GMT\r\n" ..
+			"content-length: 13\r\n"
+		local request = "GET /some/path HTTP/1.1\r\n" .. fields .. "\r\n" ..
+			"Hello World!\n"
+
+		local h = levee.Hub()
+		local r, w = h.io:pipe()
+		local stream = r:stream()
+		-- the header block arrives in two parts
+		h:spawn(function()
+			w:write(request:sub(1, 40))
+			h:sleep(10)
+			w:write(request:sub(41))
+		end)
+
+		local parser = HTTP.Parser()
+		local err, req = HTTP.decode_request(parser, stream, true)
+		assert(not err)
+		assert.equal(req.method, "GET")
+		assert.equal(req.path, "/some/path")
+		assert.equal(req.len, 13)
+		assert.equal(ffi.string(stream:value(), req.len), "Hello World!\n")
+
+		local headers = req.headers
+		assert.equal(headers["Host"], "example.com")
+		assert.equal(headers["host"], "example.com")
+		assert.equal(headers["Content-Length"], "13")
+		assert.equal(headers["Connection"], nil)
+		assert.equal(headers["h1"], "one")
+		assert.same(headers["H2"], {"two", "too"})
+		assert.equal(headers["H3"], nil)
+
+		-- encoded as it was received
+		assert.equal(tostring(headers), fields)
+		local buf = levee.d.Buffer(4096)
+		HTTP.encode_response(buf, 200, headers)
+		assert.equal(buf:peek(), "HTTP/1.1 200 OK\r\n" .. fields .. "\r\n")
+
+		-- until it's changed
+		headers["H1"] = "uno"
+		headers:add("H3", "three")
+		assert.equal(headers["H1"], "uno")
+		assert.equal(headers["h3"], "three")
+		assert.equal(headers["Host"], "example.com")
+		assert(tostring(headers):find("H3: three", 1, true))
+	end,
+
+	test_encode_view = function()
+		local levee = require("levee")
+
+		local function view(message)
+			local h = levee.Hub()
+			local r, w = h.io:pipe()
+			local stream = r:stream()
+			w:write(message)
+			local parser = HTTP.Parser()
+			if message:find("^HTTP") then
+				local err, res = HTTP.decode_response(parser, stream, true)
+				assert(not err)
+				return res.headers
+			end
+			local err, req = HTTP.decode_request(parser, stream, true)
+			assert(not err)
+			return req.headers
+		end
+
+		local function decode(buf, decoder)
+			local h = levee.Hub()
+			local r, w = h.io:pipe()
+			local stream = r:stream()
+			w:write(buf:peek())
+			local err, m = decoder(HTTP.Parser(), stream)
+			assert(not err)
+			return m, ffi.string(stream:value(), m.len)
+		end
+
+		-- a proxied request's headers, already with a Content-Length
+		local headers = view(
+			"POST / HTTP/1.1\r\nHost: up\r\nContent-Length: 2\r\n\r\nhi")
+		local buf = levee.d.Buffer(4096)
+		assert(not HTTP.encode_request(buf, "POST", "/", nil, headers, "hello"))
+		local req, body = decode(buf, HTTP.decode_request)
+		assert.equal(req.headers["Host"], "up")
+		assert.equal(body, "hello")
+
+		-- a proxied response's headers
+		local headers = view(
+			"HTTP/1.1 200 OK\r\nDate: Sun, 18 Oct 2009 08:56:53 GMT\r\n" ..
+			"H1: one\r\nContent-Length: 2\r\n\r\nhi")
+		local buf = levee.d.Buffer(4096)
+		assert(not HTTP.encode_response(buf, 200, headers, "hello"))
+		local res, body = decode(buf, HTTP.decode_response)
+		assert.equal(res.headers["H1"], "one")
+		assert.equal(res.headers["Content-Length"], "5")
+		assert.equal(body, "hello")
+	end,
+
 	test_decode_request_uri = function()
 		local levee = require("levee")
 
@@ -819,6 +924,138 @@ return {
 			assert.equal(cat(tmp), BODY)
 		end,
 
+		test_pipeline = function()
+			local h = levee.Hub()
+
+			local err, serve = h.stream:listen()
+			serve:spawn_every(function(conn)
+				for req in conn.p.http do
+					if req.method == "HEAD" then
+						conn.p.http:write_response(200, {["Content-Length"]="10"})
+					elseif req.path == "/chunked" then
+						conn.p.http:write_response(200, {})
+						conn.p.http:write_chunk("YARG")
+						conn.p.http:write_chunk(0)
+					elseif req.path == "/close" then
+						conn.p.http:write_response(200, {Connection="close"}, "bye")
+						conn:close()
+						return
+					else
+						conn.p.http:write_response(200, {}, req.path)
+					end
+				end
+			end)
+
+			local err, c = h.stream:dial(serve:port())
+			local pipeline = c.p.http:pipeline(2)
+			pipeline:get("/1")
+			pipeline:head("/2")
+			pipeline:get("/chunked")
+			pipeline:get("/3")
+			pipeline:get("/close")
+			pipeline:get("/4")
+
+			local err, res = pipeline:recv()
+			assert.equal(res.request.path, "/1")
+			assert.same({res.body:tostring()}, {nil, "/1"})
+
+			-- a HEAD response has no body, despite its Content-Length
+			local err, res = pipeline:recv()
+			assert.equal(res.request.path, "/2")
+			assert.equal(res.headers["Content-Length"], "10")
+			assert.same({res.body:tostring()}, {nil, ""})
+
+			-- a body that isn't read is discarded
+			local err, res = pipeline:recv()
+			assert.equal(res.request.path, "/chunked")
+
+			local err, res = pipeline:recv()
+			assert.equal(res.request.path, "/3")
+			assert.same({res.body:tostring()}, {nil, "/3"})
+
+			local err, res = pipeline:recv()
+			assert.equal(res.request.path, "/close")
+			assert.same({res.body:tostring()}, {nil, "bye"})
+
+			assert.equal(pipeline:recv(), levee.errors.CLOSED)
+			local unanswered = pipeline:unanswered()
+			assert.equal(#unanswered, 1)
+			assert.equal(unanswered[1].path, "/4")
+
+			local stats = pipeline:stats()
+			assert.equal(stats.sent, 6)
+			assert.equal(stats.received, 5)
+		end,
+
+		test_pipeline_interim = function()
+			local h = levee.Hub()
+
+			local err, serve = h.stream:listen()
+			serve:spawn_every(function(conn)
+				local err, req = conn.p.http:read_request()
+				conn:write(
+					"HTTP/1.1 100 Continue\r\n\r\n" ..
+					"HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok")
+			end)
+
+			local err, c = h.stream:dial(serve:port())
+			local pipeline = c.p.http:pipeline()
+			local headers = {["X-Test"]="1"}
+			pipeline:post("/", {headers=headers, data="foo"})
+
+			-- the 100 is skipped, and the 200 answers the request
+			local err, res = pipeline:recv()
+			assert.equal(res.code, 200)
+			assert.equal(res.request.path, "/")
+			assert.same({res.body:tostring()}, {nil, "ok"})
+
+			-- the request's headers are left as they were given
+			assert.same(headers, {["X-Test"]="1"})
+			assert.same(pipeline:unanswered(), {})
+
+			local stats = pipeline:stats()
+			assert.equal(stats.received, 1)
+			assert.equal(stats.interim, 1)
+		end,
+
+		test_pipeline_encode_error = function()
+			local h = levee.Hub()
+
+			local err, serve = h.stream:listen()
+			serve:spawn_every(function(conn)
+				for req in conn.p.http do
+					conn.p.http:write_response(200, {}, req.path)
+				end
+			end)
+
+			local err, c = h.stream:dial(serve:port())
+			local pipeline = c.p.http:pipeline()
+			pipeline:get("/1")
+			pipeline:get("/\222")
+			pipeline:get("/2")
+
+			-- the request that can't be encoded is reported, and the rest go on
+			local err = pipeline:recv()
+			assert(err.is_utf8_ETOOSHORT)
+
+			local err, res = pipeline:recv()
+			assert.equal(res.request.path, "/1")
+			assert.same({res.body:tostring()}, {nil, "/1"})
+			local err, res = pipeline:recv()
+			assert.equal(res.request.path, "/2")
+			assert.same({res.body:tostring()}, {nil, "/2"})
+			assert.equal(pipeline:recv(), levee.errors.CLOSED)
+
+			local unanswered = pipeline:unanswered()
+			assert.equal(#unanswered, 1)
+			assert.equal(unanswered[1].path, "/\222")
+			assert(unanswered[1].err.is_utf8_ETOOSHORT)
+
+			local stats = pipeline:stats()
+			assert.equal(stats.sent, 2)
+			assert.equal(stats.failed, 1)
+		end,
+
 		test_host_header = function()
 			local h = levee.Hub()
 
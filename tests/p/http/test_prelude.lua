@@ -0,0 +1,33 @@
+local levee = require("levee")
+local Prelude = require("levee.p.http.prelude")
+
+
+return {
+	test_date = function()
+		local h = levee.Hub()
+		local prelude = h.http.prelude
+
+		assert.equal(prelude:date(), Prelude.httpdate(h:time()))
+		assert(prelude.ticking)
+
+		-- refreshed on the next second
+		h:sleep(1100)
+		assert.equal(prelude:date(), Prelude.httpdate(h:time()))
+		assert(prelude.refreshes >= 1)
+
+		-- and the timer stops once it isn't
+		h:sleep(2100)
+		assert(not prelude.ticking)
+		assert.equal(prelude:date(), Prelude.httpdate(h:time()))
+		assert(prelude.ticking)
+	end,
+
+	test_status = function()
+		local h = levee.Hub()
+		assert.equal(h.http.prelude:status(404), "HTTP/1.1 404 Not Found\r\n")
+		assert.equal(
+			h.http.prelude:status(levee.HTTPStatus(201)), "HTTP/1.1 201 Created\r\n")
+		-- known statuses are formatted before any response is sent
+		assert.equal(rawget(levee.HTTPStatus(200), "_line"), "HTTP/1.1 200 OK\r\n")
+	end,
+}